@@ -0,0 +1,315 @@
+#include "../source/pch.h"
+
+// Passes messages from vision to world to strategy over inproc nng sockets, with world forwarding the
+// NngMessage it received as is, and checks that no hop copies the payload:
+// - the heap allocations of every send and receive call are counted, on the thread making the call
+// - the payload has to arrive at strategy at the address vision wrote it to
+// A copying send is measured too, to show that the counting catches a copy.
+//
+// usage: nng_benchmark [--messages=10000] [--size=65536]
+//
+// Counting the allocations interposes malloc, which needs glibc.
+
+using namespace Immortals::Common;
+
+#if defined(__GLIBC__)
+extern "C" void *__libc_malloc(size_t t_size);
+extern "C" void *__libc_calloc(size_t t_count, size_t t_size);
+extern "C" void *__libc_realloc(void *t_pointer, size_t t_size);
+
+namespace
+{
+// only the thread of the measured call counts, so background threads don't add noise
+thread_local bool s_counting = false;
+
+thread_local size_t s_allocations         = 0;
+thread_local size_t s_payload_allocations = 0;
+
+// allocations at least this large are taken as a copy of the payload
+size_t s_payload_size = std::numeric_limits<size_t>::max();
+
+void countAllocation(const size_t t_size)
+{
+    if (!s_counting)
+        return;
+
+    ++s_allocations;
+    if (t_size >= s_payload_size)
+        ++s_payload_allocations;
+}
+} // namespace
+
+extern "C" void *malloc(const size_t t_size) noexcept
+{
+    countAllocation(t_size);
+    return __libc_malloc(t_size);
+}
+
+extern "C" void *calloc(const size_t t_count, const size_t t_size) noexcept
+{
+    countAllocation(t_count * t_size);
+    return __libc_calloc(t_count, t_size);
+}
+
+extern "C" void *realloc(void *const t_pointer, const size_t t_size) noexcept
+{
+    countAllocation(t_size);
+    return __libc_realloc(t_pointer, t_size);
+}
+
+namespace
+{
+struct Settings
+{
+    size_t messages = 10'000;
+    size_t size     = 65'536;
+};
+
+bool parseSettings(const int t_argc, char **t_argv, Settings *t_settings)
+{
+    for (int i = 1; i < t_argc; ++i)
+    {
+        const std::string_view arg       = t_argv[i];
+        const size_t           separator = arg.find('=');
+        if (!arg.starts_with("--") || separator == std::string_view::npos)
+        {
+            std::fprintf(stderr, "Unknown argument: %s\n", t_argv[i]);
+            return false;
+        }
+
+        const std::string_view name  = arg.substr(2, separator - 2);
+        const std::string      value = std::string{arg.substr(separator + 1)};
+
+        if (name == "messages")
+            t_settings->messages = std::max<size_t>(1, std::stoull(value));
+        else if (name == "size")
+            t_settings->size = std::max<size_t>(1, std::stoull(value));
+        else
+        {
+            std::fprintf(stderr, "Unknown argument: %s\n", t_argv[i]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+class Step
+{
+public:
+    explicit Step(const char *const t_name) : m_name(t_name)
+    {}
+
+    template <typename Function>
+    auto measure(Function &&t_function)
+    {
+        s_allocations         = 0;
+        s_payload_allocations = 0;
+        s_counting            = true;
+
+        auto result = t_function();
+
+        s_counting = false;
+
+        m_allocations += s_allocations;
+        m_payload_copies += s_payload_allocations;
+        ++m_calls;
+
+        return result;
+    }
+
+    void print() const
+    {
+        std::printf("%-28s %10zu calls %10.2f allocations/call %10.2f payload copies/call\n", m_name, m_calls,
+                    static_cast<double>(m_allocations) / std::max<size_t>(1, m_calls),
+                    static_cast<double>(m_payload_copies) / std::max<size_t>(1, m_calls));
+    }
+
+    [[nodiscard]] size_t payloadCopies() const
+    {
+        return m_payload_copies;
+    }
+
+private:
+    const char *m_name;
+
+    size_t m_calls          = 0;
+    size_t m_allocations    = 0;
+    size_t m_payload_copies = 0;
+};
+
+NngMessage makeMessage(const size_t t_size, const uint64_t t_index)
+{
+    NngMessage message{t_size};
+    if (message.mutableTime() != nullptr)
+    {
+        *message.mutableTime() = t_index;
+        std::memset(message.data(), static_cast<int>(t_index), message.size());
+    }
+    return message;
+}
+
+// pub sockets drop messages until the subscription has gone through, so wait for the first one
+bool connect(NngServer *const t_server, NngClient *const t_client, const size_t t_size)
+{
+    for (int attempt = 0; attempt < 100; ++attempt)
+    {
+        t_server->sendRaw(makeMessage(t_size, 0));
+        if (t_client->receiveRaw(Duration::fromMilliseconds(10)).data() != nullptr)
+            return true;
+    }
+    return false;
+}
+
+// drains what the connection attempts left in the socket
+void drain(NngClient *const t_client)
+{
+    while (t_client->receiveRaw(Duration::fromMilliseconds(10)).data() != nullptr)
+    {}
+}
+} // namespace
+
+int main(const int argc, char **argv)
+{
+    Settings settings;
+    if (!parseSettings(argc, argv, &settings))
+        return 1;
+
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "immortals_nng_benchmark" /
+                                      std::to_string(TimePoint::now().microseconds());
+    std::filesystem::create_directories(dir);
+
+    Services::Params params{};
+#if FEATURE_CONFIG_FILE
+    params.t_config_path = dir / "config.toml";
+    std::ofstream{params.t_config_path};
+#endif
+#if FEATURE_STORAGE
+    params.t_db_path = dir;
+#endif
+
+    if (!Services::initialize(params))
+    {
+        std::fprintf(stderr, "Failed to initialize the services\n");
+        return 1;
+    }
+
+    bool result = true;
+
+    {
+        NngServer vision{"inproc://nng_benchmark_vision"};
+        NngClient world_client{"inproc://nng_benchmark_vision"};
+        NngServer world{"inproc://nng_benchmark_world"};
+        NngClient strategy{"inproc://nng_benchmark_world"};
+
+        if (!connect(&vision, &world_client, settings.size) || !connect(&world, &strategy, settings.size))
+        {
+            std::fprintf(stderr, "Failed to connect the inproc sockets\n");
+            result = false;
+        }
+
+        drain(&world_client);
+        drain(&strategy);
+
+        s_payload_size = settings.size;
+
+        Step send{"vision sendRaw (move)"};
+        Step receive{"world receiveRaw"};
+        Step forward{"world sendRaw (move)"};
+        Step arrive{"strategy receiveRaw"};
+        Step copy{"vision sendRaw (copy)"};
+
+        size_t lost  = 0;
+        size_t moved = 0;
+
+        for (size_t i = 0; result && i < settings.messages; ++i)
+        {
+            NngMessage message = makeMessage(settings.size, i + 1);
+
+            const char *const payload = message.data();
+
+            send.measure([&] { return vision.sendRaw(std::move(message)); });
+
+            NngMessage received =
+                receive.measure([&] { return world_client.receiveRaw(Duration::fromMilliseconds(100)); });
+            if (received.data() == nullptr)
+            {
+                ++lost;
+                continue;
+            }
+
+            forward.measure([&] { return world.sendRaw(std::move(received)); });
+
+            const NngMessage arrived =
+                arrive.measure([&] { return strategy.receiveRaw(Duration::fromMilliseconds(100)); });
+            if (arrived.data() == nullptr)
+            {
+                ++lost;
+                continue;
+            }
+
+            if (arrived.data() == payload)
+                ++moved;
+        }
+
+        // a copy is only sent to check the counting, the receiver drops it
+        for (size_t i = 0; result && i < std::min<size_t>(settings.messages, 100); ++i)
+        {
+            const NngMessage message = makeMessage(settings.size, i + 1);
+
+            copy.measure([&] { return vision.sendRaw(message); });
+            world_client.receiveRaw(Duration::fromMilliseconds(100));
+        }
+
+        std::printf("%zu messages of %zu bytes, vision -> world -> strategy over inproc\n\n", settings.messages,
+                    settings.size);
+
+        send.print();
+        receive.print();
+        forward.print();
+        arrive.print();
+        copy.print();
+
+        std::printf("\n%zu of %zu payloads arrived at the address they were written to, %zu were lost\n", moved,
+                    settings.messages - lost, lost);
+
+        if (result)
+        {
+            if (send.payloadCopies() + receive.payloadCopies() + forward.payloadCopies() + arrive.payloadCopies() > 0)
+            {
+                std::fprintf(stderr, "A hop copied the payload\n");
+                result = false;
+            }
+
+            if (copy.payloadCopies() == 0)
+            {
+                std::fprintf(stderr, "The copying send wasn't counted, the allocation counting doesn't work\n");
+                result = false;
+            }
+
+            if (lost == settings.messages)
+            {
+                std::fprintf(stderr, "No message made it through\n");
+                result = false;
+            }
+            else if (moved != settings.messages - lost)
+            {
+                std::fprintf(stderr, "A payload was copied outside the measured calls\n");
+                result = false;
+            }
+        }
+    }
+
+    Services::shutdown();
+
+    std::filesystem::remove_all(dir);
+
+    return result ? 0 : 1;
+}
+#else
+int main()
+{
+    std::fprintf(stderr, "Counting allocations needs glibc to interpose malloc\n");
+    return 0;
+}
+#endif
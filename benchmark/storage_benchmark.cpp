@@ -0,0 +1,546 @@
+#include "../source/pch.h"
+
+// Generates a synthetic recording (raw vision, world state and debug wrappers) and measures
+// how fast Storage writes and reads it back.
+//
+// usage: storage_benchmark [--dir=<path>] [--seconds=60] [--vision-rate=60] [--debug-rate=60]
+//                          [--cameras=4] [--robots=11] [--draws=500] [--batch-ms=100]
+//                          [--unbatched=500] [--reads=10000] [--keep]
+
+using namespace Immortals::Common;
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+struct Settings
+{
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "immortals_storage_benchmark";
+
+    float seconds = 60.0f;
+
+    unsigned vision_rate = 60;
+    unsigned debug_rate  = 60;
+
+    unsigned cameras = 4;
+    unsigned robots  = 11;
+    unsigned draws   = 500;
+
+    unsigned batch_ms = 100;
+
+    // every unbatched write is its own synced commit, so only a few of them are measured
+    unsigned unbatched = 500;
+    unsigned reads     = 10'000;
+
+    bool keep = false;
+};
+
+bool parseSettings(const int t_argc, char **t_argv, Settings *t_settings)
+{
+    for (int i = 1; i < t_argc; ++i)
+    {
+        const std::string_view arg = t_argv[i];
+
+        if (arg == "--keep")
+        {
+            t_settings->keep = true;
+            continue;
+        }
+
+        const size_t separator = arg.find('=');
+        if (!arg.starts_with("--") || separator == std::string_view::npos)
+        {
+            std::fprintf(stderr, "Unknown argument: %s\n", t_argv[i]);
+            return false;
+        }
+
+        const std::string_view name  = arg.substr(2, separator - 2);
+        const std::string      value = std::string{arg.substr(separator + 1)};
+
+        if (name == "dir")
+            t_settings->dir = value;
+        else if (name == "seconds")
+            t_settings->seconds = std::stof(value);
+        else if (name == "vision-rate")
+            t_settings->vision_rate = std::stoul(value);
+        else if (name == "debug-rate")
+            t_settings->debug_rate = std::stoul(value);
+        else if (name == "cameras")
+            t_settings->cameras = std::max(1u, static_cast<unsigned>(std::stoul(value)));
+        else if (name == "robots")
+            t_settings->robots = std::min<unsigned long>(Config::Common::kMaxRobots, std::stoul(value));
+        else if (name == "draws")
+            t_settings->draws = std::stoul(value);
+        else if (name == "batch-ms")
+            t_settings->batch_ms = std::stoul(value);
+        else if (name == "unbatched")
+            t_settings->unbatched = std::stoul(value);
+        else if (name == "reads")
+            t_settings->reads = std::stoul(value);
+        else
+        {
+            std::fprintf(stderr, "Unknown argument: %s\n", t_argv[i]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+class Generator
+{
+public:
+    explicit Generator(const Settings &t_settings) : m_settings(t_settings)
+    {}
+
+    void rawWorld(const TimePoint t_time, std::string *t_data)
+    {
+        RawWorldState state;
+        state.time = t_time;
+
+        for (unsigned camera = 0; camera < m_settings.cameras; ++camera)
+        {
+            RawFrame frame;
+            frame.camera_id        = camera;
+            frame.frame_number     = m_frame_number;
+            frame.t_capture        = t_time;
+            frame.t_capture_camera = t_time;
+            frame.t_sent           = t_time + Duration::fromMicroseconds(500);
+            state.frames.push_back(frame);
+
+            RawBallState ball;
+            ball.frame_idx      = camera;
+            ball.frame          = frame;
+            ball.confidence     = m_random.get(0.5f, 1.0f);
+            ball.position       = Vec3(m_random.get(-6000.0f, 6000.0f), m_random.get(-4500.0f, 4500.0f), 0.0f);
+            ball.pixel_position = Vec2(m_random.get(0.0f, 1920.0f), m_random.get(0.0f, 1200.0f));
+            ball.area           = m_random.get(50, 200);
+            state.balls.push_back(ball);
+
+            for (const TeamColor color : {TeamColor::Yellow, TeamColor::Blue})
+            {
+                auto &robots = color == TeamColor::Yellow ? state.yellow_robots : state.blue_robots;
+
+                for (unsigned id = 0; id < m_settings.robots; ++id)
+                {
+                    RawRobotState robot;
+                    robot.frame_idx      = camera;
+                    robot.frame          = frame;
+                    robot.confidence     = m_random.get(0.5f, 1.0f);
+                    robot.id             = static_cast<int>(id);
+                    robot.color          = color;
+                    robot.height         = 150.0f;
+                    robot.position       = Vec2(m_random.get(-6000.0f, 6000.0f), m_random.get(-4500.0f, 4500.0f));
+                    robot.pixel_position = Vec2(m_random.get(0.0f, 1920.0f), m_random.get(0.0f, 1200.0f));
+                    robot.angle          = Angle::fromDeg(m_random.get(-180.0f, 180.0f));
+                    robots.push_back(robot);
+                }
+            }
+        }
+
+        ++m_frame_number;
+
+        Protos::Immortals::RawWorldState proto;
+        state.fillProto(&proto);
+        proto.SerializeToString(t_data);
+    }
+
+    void world(const TimePoint t_time, std::string *t_data)
+    {
+        WorldState state;
+        state.time = t_time;
+
+        state.ball.position   = Vec2(m_random.get(-6000.0f, 6000.0f), m_random.get(-4500.0f, 4500.0f));
+        state.ball.velocity   = Vec2(m_random.get(-3000.0f, 3000.0f), m_random.get(-3000.0f, 3000.0f));
+        state.ball.seen_state = SeenState::Seen;
+
+        for (auto *const robots : {state.own_robot, state.opp_robot})
+        {
+            for (unsigned id = 0; id < m_settings.robots; ++id)
+            {
+                RobotState &robot = robots[id];
+                robot.color              = robots == state.own_robot ? TeamColor::Yellow : TeamColor::Blue;
+                robot.position           = Vec2(m_random.get(-6000.0f, 6000.0f), m_random.get(-4500.0f, 4500.0f));
+                robot.velocity           = Vec2(m_random.get(-2000.0f, 2000.0f), m_random.get(-2000.0f, 2000.0f));
+                robot.angle              = Angle::fromDeg(m_random.get(-180.0f, 180.0f));
+                robot.angular_velocity   = Angle::fromDeg(m_random.get(-360.0f, 360.0f));
+                robot.seen_state         = SeenState::Seen;
+                robot.out_for_substitute = false;
+            }
+        }
+
+        Protos::Immortals::WorldState proto;
+        state.fillProto(&proto);
+        proto.SerializeToString(t_data);
+    }
+
+#if FEATURE_DEBUG
+    void debugWrapper(const TimePoint t_time, std::string *t_data)
+    {
+        Debug::Wrapper wrapper;
+        wrapper.time = t_time;
+        wrapper.draws.reserve(m_settings.draws);
+
+        for (unsigned i = 0; i < m_settings.draws; ++i)
+        {
+            Debug::Draw draw;
+            draw.source = m_sources[i % m_sources.size()];
+            draw.color  = Color::red();
+            draw.filled = (i % 2) == 0;
+
+            const Vec2 point = Vec2(m_random.get(-6000.0f, 6000.0f), m_random.get(-4500.0f, 4500.0f));
+
+            switch (i % 3)
+            {
+            case 0:
+                draw.shape = point;
+                break;
+            case 1:
+                draw.shape = Circle{point, m_random.get(10.0f, 500.0f)};
+                break;
+            default:
+                draw.shape = LineSegment{point, Vec2(m_random.get(-6000.0f, 6000.0f), m_random.get(-4500.0f, 4500.0f))};
+                break;
+            }
+
+            wrapper.draws.push_back(draw);
+        }
+
+        Protos::Immortals::Debug::Wrapper proto;
+        wrapper.fillProto(&proto);
+        proto.SerializeToString(t_data);
+    }
+#endif
+
+private:
+    const Settings &m_settings;
+
+    Random m_random;
+
+    unsigned m_frame_number = 0;
+
+#if FEATURE_DEBUG
+    // a real frame draws from a handful of call sites, which is what keeps the string table small
+    const std::array<Debug::SourceLocation, 4> m_sources = {
+        Debug::SourceLocation{std::source_location::current()},
+        Debug::SourceLocation{std::source_location::current()},
+        Debug::SourceLocation{std::source_location::current()},
+        Debug::SourceLocation{std::source_location::current()},
+    };
+#endif
+};
+
+class Results
+{
+public:
+    void add(const Clock::duration t_latency, const size_t t_bytes = 0)
+    {
+        m_latencies.push_back(t_latency);
+        m_total += t_latency;
+        m_bytes += t_bytes;
+    }
+
+    void print(const char *const t_name)
+    {
+        if (m_latencies.empty())
+        {
+            std::printf("%-24s no operations\n", t_name);
+            return;
+        }
+
+        std::sort(m_latencies.begin(), m_latencies.end());
+
+        const double seconds = std::chrono::duration<double>(m_total).count();
+
+        std::printf("%-24s %10zu ops %12.0f ops/s %10.2f MB/s  p50 %9.1f us  p99 %9.1f us  max %9.1f us\n", t_name,
+                    m_latencies.size(), m_latencies.size() / seconds, m_bytes / seconds / (1024.0 * 1024.0),
+                    microseconds(percentile(0.5)), microseconds(percentile(0.99)), microseconds(m_latencies.back()));
+    }
+
+private:
+    Clock::duration percentile(const double t_fraction) const
+    {
+        const size_t index = static_cast<size_t>(t_fraction * (m_latencies.size() - 1));
+        return m_latencies[index];
+    }
+
+    static double microseconds(const Clock::duration t_duration)
+    {
+        return std::chrono::duration<double, std::micro>(t_duration).count();
+    }
+
+    std::vector<Clock::duration> m_latencies;
+
+    Clock::duration m_total{};
+    size_t          m_bytes = 0;
+};
+
+template <typename Function>
+Clock::duration measure(Function &&t_function)
+{
+    const Clock::time_point start = Clock::now();
+    t_function();
+    return Clock::now() - start;
+}
+
+struct Stream
+{
+    const char *name;
+
+    Storage storage;
+
+    Storage::Key period;
+    Storage::Key next_key;
+
+    std::function<void(TimePoint, std::string *)> generate;
+
+    Results writes;
+};
+
+uintmax_t directorySize(const std::filesystem::path &t_path)
+{
+    uintmax_t size = 0;
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(t_path))
+    {
+        if (entry.is_regular_file())
+            size += entry.file_size();
+    }
+    return size;
+}
+
+// Writes a few records through store with their own commit each, the cost a caller pays without a batch
+void benchmarkUnbatched(Generator *t_generator, const Settings &t_settings, const Storage::Key t_start)
+{
+    Storage storage;
+    if (!storage.open("unbatched"))
+        return;
+
+    Results results;
+    std::string data;
+
+    const Storage::Key period = 1'000'000 / std::max(1u, t_settings.vision_rate);
+
+    for (unsigned i = 0; i < t_settings.unbatched; ++i)
+    {
+        const Storage::Key key = t_start + i * period;
+
+        t_generator->world(TimePoint::fromMicroseconds(key), &data);
+
+        Protos::Immortals::WorldState proto;
+        proto.ParseFromString(data);
+
+        results.add(measure([&] { storage.store(key, proto); }), data.size());
+    }
+
+    results.print("store (unbatched)");
+}
+
+// Replays the recording through storeRaw in time order, like the dumper does
+bool benchmarkBatched(std::span<Stream> t_streams, const Settings &t_settings, const Storage::Key t_end)
+{
+    Storage::Batch batch{Duration::fromMilliseconds(t_settings.batch_ms)};
+
+    Results all;
+    std::string data;
+
+    while (true)
+    {
+        Stream *stream = nullptr;
+        for (Stream &candidate : t_streams)
+        {
+            if (candidate.next_key < t_end && (stream == nullptr || candidate.next_key < stream->next_key))
+                stream = &candidate;
+        }
+
+        if (stream == nullptr)
+            break;
+
+        const Storage::Key key = stream->next_key;
+        stream->next_key += stream->period;
+
+        stream->generate(TimePoint::fromMicroseconds(key), &data);
+
+        bool result = false;
+
+        const Clock::duration latency =
+            measure([&] { result = stream->storage.storeRaw(key, std::span{data.data(), data.size()}, &batch); });
+
+        if (!result)
+        {
+            fmt::print(stderr, "Failed to store {} at {}\n", stream->name, key);
+            return false;
+        }
+
+        stream->writes.add(latency, data.size());
+        all.add(latency, data.size());
+    }
+
+    const Clock::duration commit = measure([&] { batch.commit(); });
+
+    for (Stream &stream : t_streams)
+        stream.writes.print(stream.name);
+
+    all.add(commit);
+    all.print("storeRaw (all, batched)");
+
+    return true;
+}
+
+void benchmarkReads(const Stream &t_stream, const Settings &t_settings, const Storage::Key t_start,
+                    const Storage::Key t_end)
+{
+    Random random;
+
+    Results boundary;
+    Results get;
+    Results get_raw;
+    Results closest;
+    Results next;
+    Results scan;
+
+    Storage::Key first = 0;
+    Storage::Key last  = 0;
+    boundary.add(measure([&] { t_stream.storage.getBoundary(&first, &last); }));
+
+    const auto randomKey = [&]
+    {
+        const float fraction = random.get(0.0f, 1.0f);
+        return t_start + static_cast<Storage::Key>(fraction * (t_end - t_start));
+    };
+
+    for (unsigned i = 0; i < t_settings.reads; ++i)
+    {
+        Storage::Key key = 0;
+        closest.add(measure([&] { t_stream.storage.closest(randomKey(), &key); }));
+
+        Storage::Key next_key = 0;
+        next.add(measure([&] { t_stream.storage.next(key, &next_key); }));
+
+        Protos::Immortals::WorldState proto;
+        get.add(measure([&] { t_stream.storage.get(key, &proto); }), proto.ByteSizeLong());
+
+        Storage::View view;
+        get_raw.add(measure([&] { t_stream.storage.getRaw(key, &view); }), view.data().size());
+    }
+
+    Storage::Range range;
+    size_t         count = 0;
+    size_t         bytes = 0;
+
+    const Clock::duration scan_time = measure(
+        [&]
+        {
+            if (!t_stream.storage.range(first, last + 1, &range))
+                return;
+
+            for (const Storage::Record &record : range)
+            {
+                ++count;
+                bytes += record.data.size();
+            }
+        });
+
+    // a single pass, reported per record
+    for (size_t i = 0; i < count; ++i)
+        scan.add(scan_time / count, bytes / count);
+
+    std::printf("\nreads on %s (%zu records)\n", t_stream.name, count);
+    boundary.print("getBoundary");
+    closest.print("closest");
+    next.print("next");
+    get.print("get");
+    get_raw.print("getRaw");
+    scan.print("range");
+}
+} // namespace
+
+int main(const int argc, char **argv)
+{
+    Settings settings;
+    if (!parseSettings(argc, argv, &settings))
+        return 1;
+
+    // never reuse an existing recording, the results would depend on what's already in it
+    const std::filesystem::path db_path =
+        settings.dir / std::to_string(TimePoint::now().microseconds());
+
+    std::filesystem::create_directories(db_path);
+
+    Services::Params params{};
+#if FEATURE_CONFIG_FILE
+    params.t_config_path = db_path / "config.toml";
+    std::ofstream{params.t_config_path};
+#endif
+    params.t_db_path = db_path;
+
+    if (!Services::initialize(params))
+    {
+        std::fprintf(stderr, "Failed to initialize the storage at %s\n", db_path.string().c_str());
+        return 1;
+    }
+
+    Generator generator{settings};
+
+    const Storage::Key start = TimePoint::now().microseconds();
+    const Storage::Key end   = start + static_cast<Storage::Key>(settings.seconds * 1'000'000.0f);
+
+    const auto period = [](const unsigned t_rate)
+    { return static_cast<Storage::Key>(1'000'000 / std::max(1u, t_rate)); };
+
+    std::vector<Stream> streams;
+    streams.reserve(3);
+
+    streams.push_back({.name     = "storeRaw (raw world)",
+                       .period   = period(settings.vision_rate),
+                       .next_key = start,
+                       .generate = [&](const TimePoint t_time, std::string *t_data)
+                       { generator.rawWorld(t_time, t_data); }});
+    streams.push_back({.name     = "storeRaw (world)",
+                       .period   = period(settings.vision_rate),
+                       .next_key = start,
+                       .generate = [&](const TimePoint t_time, std::string *t_data)
+                       { generator.world(t_time, t_data); }});
+#if FEATURE_DEBUG
+    if (settings.draws > 0)
+    {
+        streams.push_back({.name     = "storeRaw (debug)",
+                           .period   = period(settings.debug_rate),
+                           .next_key = start,
+                           .generate = [&](const TimePoint t_time, std::string *t_data)
+                           { generator.debugWrapper(t_time, t_data); }});
+    }
+#endif
+
+    const char *const db_names[] = {"raw", "world", "debug"};
+
+    bool result = true;
+    for (size_t i = 0; i < streams.size(); ++i)
+        result = result && streams[i].storage.open(db_names[i]);
+
+    std::printf("recording %.1f s: vision %u Hz, debug %u Hz, %u cameras, %u robots per team, %u draws, "
+                "batch window %u ms\n\n",
+                settings.seconds, settings.vision_rate, settings.debug_rate, settings.cameras, settings.robots,
+                settings.draws, settings.batch_ms);
+
+    if (result)
+    {
+        benchmarkUnbatched(&generator, settings, start);
+
+        result = benchmarkBatched(streams, settings, end);
+    }
+
+    if (result)
+        benchmarkReads(streams[1], settings, start, end);
+
+    for (Stream &stream : streams)
+        stream.storage.close();
+
+    Services::shutdown();
+
+    std::printf("\non-disk size %.2f MB at %s\n", directorySize(db_path) / (1024.0 * 1024.0), db_path.string().c_str());
+
+    if (!settings.keep)
+        std::filesystem::remove_all(db_path);
+
+    return result ? 0 : 1;
+}
@@ -54,6 +54,8 @@ struct Network final : IConfig
     std::string raw_world_state_url = "inproc://raw_world_state";
     std::string world_state_url     = "inproc://world_state";
     std::string debug_url           = "inproc://debug";
+    // when set, debug draws are sent here as a DrawBatch instead of inside the debug wrapper
+    std::string debug_draw_url      = "";
     std::string referee_state_url   = "inproc://referee_state";
     std::string soccer_state_url    = "inproc://soccer_state";
     std::string commands_url        = "inproc://commands";
@@ -62,6 +64,7 @@ struct Network final : IConfig
     std::string raw_world_state_db = "raw_world_state";
     std::string world_state_db     = "world_state";
     std::string debug_db           = "debug";
+    std::string debug_draw_db      = "debug_draw";
     std::string referee_db         = "referee";
     std::string soccer_db          = "soccer";
 };
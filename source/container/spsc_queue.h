@@ -0,0 +1,71 @@
+#pragma once
+
+namespace Immortals::Common
+{
+// Bounded lock-free queue for exactly one producer and one consumer thread.
+// Values are moved in and out of preallocated slots, so no allocation happens after construction.
+template <typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(const size_t t_capacity) : m_slots(t_capacity + 1)
+    {}
+
+    SpscQueue(const SpscQueue &)            = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    // Returns false and leaves t_value untouched if the queue is full
+    bool push(T &&t_value)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        const size_t next = increment(tail);
+
+        if (next == m_head.load(std::memory_order_acquire))
+            return false;
+
+        m_slots[tail] = std::move(t_value);
+        m_tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T *const t_value)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+
+        if (head == m_tail.load(std::memory_order_acquire))
+            return false;
+
+        *t_value = std::move(m_slots[head]);
+        m_head.store(increment(head), std::memory_order_release);
+        return true;
+    }
+
+    // Only approximate while the other side is running
+    [[nodiscard]] size_t size() const
+    {
+        const size_t head = m_head.load(std::memory_order_acquire);
+        const size_t tail = m_tail.load(std::memory_order_acquire);
+
+        return tail >= head ? tail - head : tail + m_slots.size() - head;
+    }
+
+    [[nodiscard]] size_t capacity() const
+    {
+        return m_slots.size() - 1;
+    }
+
+private:
+    size_t increment(const size_t t_index) const
+    {
+        return t_index + 1 == m_slots.size() ? 0 : t_index + 1;
+    }
+
+    static constexpr size_t kCacheLineSize = 64;
+
+    std::vector<T> m_slots;
+
+    // keep the indices on separate cache lines so the two threads don't false-share
+    alignas(kCacheLineSize) std::atomic<size_t> m_head = 0;
+    alignas(kCacheLineSize) std::atomic<size_t> m_tail = 0;
+};
+} // namespace Immortals::Common
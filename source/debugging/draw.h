@@ -17,7 +17,7 @@ struct Draw
 
     Draw() = default;
 
-    Draw(const Protos::Immortals::Debug::Draw &t_draw, const StringMap &t_strings)
+    Draw(const Protos::Immortals::Debug::Draw &t_draw, const StringTable &t_strings)
     {
         source    = SourceLocation{t_draw.source(), t_strings};
         color     = Color{t_draw.color()};
@@ -50,7 +50,7 @@ struct Draw
         }
     }
 
-    void fillProto(Protos::Immortals::Debug::Draw *t_draw, StringMap *t_strings) const
+    void fillProto(Protos::Immortals::Debug::Draw *t_draw, StringTable *t_strings) const
     {
         source.fillProto(t_draw->mutable_source(), t_strings);
         color.fillProto(t_draw->mutable_color());
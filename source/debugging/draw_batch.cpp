@@ -0,0 +1,381 @@
+#include "draw_batch.h"
+
+namespace Immortals::Common::Debug
+{
+namespace
+{
+struct Header
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t palette_size;
+    uint32_t source_count;
+
+    std::array<uint32_t, DrawBatch::kShapeCount> counts;
+
+    // quantization step of the coordinates of each shape type, 0 if they are floats
+    std::array<float, DrawBatch::kShapeCount> scales;
+};
+
+template <typename T>
+T take(const char **t_cursor)
+{
+    T value;
+    std::memcpy(&value, *t_cursor, sizeof(T));
+    *t_cursor += sizeof(T);
+    return value;
+}
+} // namespace
+
+static_assert(DrawBatch::kShapeCount == 6, "the coordinate counts need updating for new shapes");
+
+bool DrawBatch::encode(const std::vector<Draw> &t_draws, StringTable *const t_strings)
+{
+    m_data.clear();
+    m_palette.clear();
+    m_palette_indices.clear();
+    m_sources.clear();
+    m_source_indices.clear();
+
+    m_draw_sources.resize(t_draws.size());
+    m_draw_colors.resize(t_draws.size());
+    m_draw_coordinates.resize(t_draws.size());
+
+    for (std::vector<uint32_t> &order : m_order)
+        order.clear();
+
+    std::array<float, kShapeCount> max_coordinates{};
+    std::array<bool, kShapeCount>  non_finite{};
+
+    for (size_t i = 0; i < t_draws.size(); ++i)
+    {
+        const Draw  &draw = t_draws[i];
+        const size_t type = draw.shape.index();
+
+        if (m_sources.size() == kMaxSourceCount && !m_source_indices.contains(Source{draw.source.fileHash(),
+                                                                                     draw.source.functionHash(),
+                                                                                     draw.source.line}))
+        {
+            logError("Too many distinct source locations in a draw batch, more than {}", kMaxSourceCount);
+            return false;
+        }
+
+        m_draw_sources[i]     = sourceIndex(draw.source, t_strings);
+        m_draw_colors[i]      = colorIndex(packColor(draw.color));
+        m_draw_coordinates[i] = coordinates(draw.shape);
+
+        for (size_t c = 0; c < kQuantizedCount[type]; ++c)
+        {
+            const float coordinate = m_draw_coordinates[i][c];
+            if (std::isfinite(coordinate))
+                max_coordinates[type] = std::max(max_coordinates[type], std::abs(coordinate));
+            else
+                non_finite[type] = true;
+        }
+
+        m_order[type].push_back(static_cast<uint32_t>(i));
+    }
+
+    Header header{};
+    header.magic        = kMagic;
+    header.version      = kVersion;
+    header.palette_size = static_cast<uint16_t>(m_palette.size());
+    header.source_count = static_cast<uint32_t>(m_sources.size());
+
+    for (size_t type = 0; type < kShapeCount; ++type)
+    {
+        header.counts[type] = static_cast<uint32_t>(m_order[type].size());
+
+        // the largest coordinate of the type maps to the end of the int16 range, unless that would make the
+        // steps coarser than kMaxQuantizationStep, then the type falls back to floats
+        const float scale   = max_coordinates[type] > 0.0f ? max_coordinates[type] / kQuantizedMax : 1.0f;
+        header.scales[type] = non_finite[type] || scale > kMaxQuantizationStep ? 0.0f : scale;
+    }
+
+    put(header);
+
+    for (const uint32_t color : m_palette)
+        put(color);
+
+    for (const Source &source : m_sources)
+    {
+        put(source.file_hash);
+        put(source.function_hash);
+        put(source.line);
+    }
+
+    const auto quantize = [](const float t_value, const float t_scale)
+    {
+        const float quantized = std::round(t_value / t_scale);
+        return static_cast<int16_t>(std::clamp(quantized, -kQuantizedMax, kQuantizedMax));
+    };
+
+    for (size_t type = 0; type < kShapeCount; ++type)
+    {
+        const std::vector<uint32_t> &order = m_order[type];
+
+        for (const uint32_t i : order)
+            put(m_draw_sources[i]);
+
+        for (const uint32_t i : order)
+            put(m_draw_colors[i]);
+
+        for (const uint32_t i : order)
+            put(static_cast<uint8_t>(t_draws[i].filled));
+
+        for (const uint32_t i : order)
+        {
+            const float thickness = std::clamp(std::round(t_draws[i].thickness * kThicknessScale), 0.0f,
+                                               static_cast<float>(std::numeric_limits<uint16_t>::max()));
+            put(static_cast<uint16_t>(thickness));
+        }
+
+        const float scale = header.scales[type];
+
+        for (size_t c = 0; c < kQuantizedCount[type]; ++c)
+        {
+            if (scale > 0.0f)
+            {
+                for (const uint32_t i : order)
+                    put(quantize(m_draw_coordinates[i][c], scale));
+            }
+            else
+            {
+                for (const uint32_t i : order)
+                    put(m_draw_coordinates[i][c]);
+            }
+        }
+
+        for (size_t c = 0; c < kFloatCount[type]; ++c)
+        {
+            for (const uint32_t i : order)
+                put(m_draw_coordinates[i][c]);
+        }
+    }
+
+    return true;
+}
+
+bool DrawBatch::decode(const std::span<const char> t_data, const StringTable &t_strings,
+                       std::vector<Draw> *const t_draws)
+{
+    if (t_data.size() < sizeof(Header))
+    {
+        logWarning("Draw batch of {} bytes is too short for its header", t_data.size());
+        return false;
+    }
+
+    const char  *cursor = t_data.data();
+    const Header header = take<Header>(&cursor);
+
+    if (header.magic != kMagic || header.version != kVersion)
+    {
+        logWarning("Unsupported draw batch, magic {:#x} version {}", header.magic, header.version);
+        return false;
+    }
+
+    size_t expected = sizeof(Header) + header.palette_size * sizeof(uint32_t) +
+                      static_cast<size_t>(header.source_count) * sizeof(Source);
+    size_t total    = 0;
+
+    constexpr size_t kFixedSize = sizeof(uint16_t) + sizeof(uint8_t) + sizeof(uint8_t) + sizeof(uint16_t);
+
+    for (size_t type = 0; type < kShapeCount; ++type)
+    {
+        if (!(header.scales[type] >= 0.0f))
+        {
+            logWarning("Draw batch has an invalid scale {}", header.scales[type]);
+            return false;
+        }
+
+        const size_t quantized_size = header.scales[type] > 0.0f ? sizeof(int16_t) : sizeof(float);
+
+        expected += static_cast<size_t>(header.counts[type]) *
+                    (kFixedSize + kQuantizedCount[type] * quantized_size + kFloatCount[type] * sizeof(float));
+        total += header.counts[type];
+    }
+
+    if (t_data.size() != expected)
+    {
+        logWarning("Draw batch is {} bytes instead of the expected {}", t_data.size(), expected);
+        return false;
+    }
+
+    std::vector<uint32_t> palette(header.palette_size);
+    for (uint32_t &color : palette)
+        color = take<uint32_t>(&cursor);
+
+    std::vector<SourceLocation> sources(header.source_count);
+    for (SourceLocation &source : sources)
+    {
+        source.file_hash     = take<XXH32_hash_t>(&cursor);
+        source.function_hash = take<XXH32_hash_t>(&cursor);
+        source.has_hashes    = true;
+        source.line          = take<int32_t>(&cursor);
+
+        source.file     = t_strings.get(source.file_hash);
+        source.function = t_strings.get(source.function_hash);
+    }
+
+    t_draws->reserve(t_draws->size() + total);
+
+    std::vector<Coordinates> coordinates;
+
+    for (size_t type = 0; type < kShapeCount; ++type)
+    {
+        const size_t count = header.counts[type];
+        const size_t first = t_draws->size();
+
+        t_draws->resize(first + count);
+        const std::span<Draw> draws{t_draws->data() + first, count};
+
+        for (Draw &draw : draws)
+        {
+            const uint16_t source = take<uint16_t>(&cursor);
+            if (source < sources.size())
+                draw.source = sources[source];
+        }
+
+        for (Draw &draw : draws)
+        {
+            const uint8_t color = take<uint8_t>(&cursor);
+            if (color < palette.size())
+                draw.color = unpackColor(palette[color]);
+        }
+
+        for (Draw &draw : draws)
+            draw.filled = take<uint8_t>(&cursor) != 0;
+
+        for (Draw &draw : draws)
+            draw.thickness = take<uint16_t>(&cursor) / kThicknessScale;
+
+        coordinates.assign(count, Coordinates{});
+
+        const float scale = header.scales[type];
+
+        for (size_t c = 0; c < kQuantizedCount[type]; ++c)
+        {
+            for (Coordinates &coordinate : coordinates)
+                coordinate[c] = scale > 0.0f ? take<int16_t>(&cursor) * scale : take<float>(&cursor);
+        }
+
+        for (size_t c = 0; c < kFloatCount[type]; ++c)
+        {
+            for (Coordinates &coordinate : coordinates)
+                coordinate[c] = take<float>(&cursor);
+        }
+
+        for (size_t i = 0; i < count; ++i)
+            draws[i].shape = shape(type, coordinates[i]);
+    }
+
+    return true;
+}
+
+DrawBatch::Coordinates DrawBatch::coordinates(const Shape &t_shape)
+{
+    Coordinates coordinates{};
+
+    if (const auto point = std::get_if<Vec2>(&t_shape); point)
+        coordinates = {point->x, point->y};
+    else if (const auto line = std::get_if<Line>(&t_shape); line)
+        coordinates = {line->a, line->b, line->c};
+    else if (const auto segment = std::get_if<LineSegment>(&t_shape); segment)
+        coordinates = {segment->start.x, segment->start.y, segment->end.x, segment->end.y};
+    else if (const auto rect = std::get_if<Rect>(&t_shape); rect)
+        coordinates = {rect->min.x, rect->min.y, rect->max.x, rect->max.y};
+    else if (const auto circle = std::get_if<Circle>(&t_shape); circle)
+        coordinates = {circle->center.x, circle->center.y, circle->r};
+    else if (const auto triangle = std::get_if<Triangle>(&t_shape); triangle)
+        coordinates = {triangle->corner[0].x, triangle->corner[0].y, triangle->corner[1].x,
+                       triangle->corner[1].y, triangle->corner[2].x, triangle->corner[2].y};
+
+    return coordinates;
+}
+
+DrawBatch::Shape DrawBatch::shape(const size_t t_type, const Coordinates &t_coordinates)
+{
+    const Coordinates &c = t_coordinates;
+
+    switch (t_type)
+    {
+    case 0:
+        return Vec2{c[0], c[1]};
+    case 1:
+        return Line{c[0], c[1], c[2]};
+    case 2:
+        return LineSegment{Vec2{c[0], c[1]}, Vec2{c[2], c[3]}};
+    case 3:
+        return Rect{Vec2{c[0], c[1]}, Vec2{c[2], c[3]}};
+    case 4:
+        return Circle{Vec2{c[0], c[1]}, c[2]};
+    default:
+        return Triangle{Vec2{c[0], c[1]}, Vec2{c[2], c[3]}, Vec2{c[4], c[5]}};
+    }
+}
+
+uint32_t DrawBatch::packColor(const Color t_color)
+{
+    const auto channel = [](const float t_value)
+    { return static_cast<uint32_t>(std::lround(std::clamp(t_value, 0.0f, 1.0f) * 255.0f)); };
+
+    return channel(t_color.r) | channel(t_color.g) << 8 | channel(t_color.b) << 16 | channel(t_color.a) << 24;
+}
+
+Color DrawBatch::unpackColor(const uint32_t t_color)
+{
+    const auto channel = [t_color](const int t_shift)
+    { return static_cast<float>(t_color >> t_shift & 0xff) / 255.0f; };
+
+    return Color{channel(0), channel(8), channel(16), channel(24)};
+}
+
+uint8_t DrawBatch::colorIndex(const uint32_t t_color)
+{
+    if (const auto it = m_palette_indices.find(t_color); it != m_palette_indices.end())
+        return it->second;
+
+    if (m_palette.size() < kMaxPaletteSize)
+    {
+        const uint8_t index = static_cast<uint8_t>(m_palette.size());
+        m_palette.push_back(t_color);
+        m_palette_indices.emplace(t_color, index);
+        return index;
+    }
+
+    const auto distance = [t_color](const uint32_t t_other)
+    {
+        int result = 0;
+        for (int shift = 0; shift < 32; shift += 8)
+        {
+            const int delta = static_cast<int>(t_color >> shift & 0xff) - static_cast<int>(t_other >> shift & 0xff);
+            result += delta * delta;
+        }
+        return result;
+    };
+
+    const auto closest = std::min_element(m_palette.begin(), m_palette.end(),
+                                          [&distance](const uint32_t t_a, const uint32_t t_b)
+                                          { return distance(t_a) < distance(t_b); });
+
+    const uint8_t index = static_cast<uint8_t>(closest - m_palette.begin());
+    m_palette_indices.emplace(t_color, index);
+    return index;
+}
+
+uint16_t DrawBatch::sourceIndex(const SourceLocation &t_source, StringTable *const t_strings)
+{
+    const Source source{t_source.fileHash(), t_source.functionHash(), t_source.line};
+
+    const auto [it, inserted] = m_source_indices.try_emplace(source, static_cast<uint16_t>(m_sources.size()));
+    if (inserted)
+    {
+        m_sources.push_back(source);
+
+        t_strings->add(source.file_hash, t_source.file);
+        t_strings->add(source.function_hash, t_source.function);
+    }
+
+    return it->second;
+}
+} // namespace Immortals::Common::Debug
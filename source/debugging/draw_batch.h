@@ -0,0 +1,109 @@
+#pragma once
+
+#include "draw.h"
+#include "string_table.h"
+
+namespace Immortals::Common::Debug
+{
+// Compact columnar encoding of the draws of a frame, several times smaller and faster to encode than a
+// repeated Draw protobuf. Draws are grouped per shape type, and each of their fields is a column:
+//
+//   header   magic, version, palette size, source count, draw count and coordinate scale per shape type
+//   palette  RGBA8 colors
+//   sources  file hash, function hash and line of every distinct source location
+//   columns  per shape type: source index, color index, filled, thickness, then one column per coordinate
+//
+// Coordinates are quantized to int16 with a scale chosen per shape type to fit the largest of them. A type
+// whose coordinates don't fit at kMaxQuantizationStep, e.g. because of a single far away draw, keeps them
+// as floats instead, as do line coefficients. Colors beyond the palette size reuse the closest palette entry.
+// Multi-byte values are in the byte order of the host, little endian on every supported platform.
+// The strings of the source locations go to the string table, to be sent with the wrapper of the frame.
+class DrawBatch
+{
+public:
+    static constexpr uint32_t kMagic          = 0x42444d49; // "IMDB"
+    static constexpr uint16_t kVersion        = 2;
+    static constexpr size_t   kMaxPaletteSize = 256;
+    static constexpr size_t   kMaxSourceCount = std::numeric_limits<uint16_t>::max() + 1;
+
+    // coarsest quantization of the coordinates, 1mm in field coordinates
+    static constexpr float kMaxQuantizationStep = 1.0f;
+
+    using Shape = decltype(Draw::shape);
+
+    static constexpr size_t kShapeCount = std::variant_size_v<Shape>;
+
+    // Encodes into the buffer of the batch, which is reused by the next call.
+    // Returns false if the draws have more distinct source locations than the batch can index.
+    bool encode(const std::vector<Draw> &t_draws, StringTable *t_strings);
+
+    [[nodiscard]] std::span<const char> data() const
+    {
+        return m_data;
+    }
+
+    // Appends the decoded draws to t_draws, whose source locations point into t_strings
+    static bool decode(std::span<const char> t_data, const StringTable &t_strings, std::vector<Draw> *t_draws);
+
+private:
+    // at most 6 coordinates per shape, a triangle
+    using Coordinates = std::array<float, 6>;
+
+    struct Source
+    {
+        XXH32_hash_t file_hash;
+        XXH32_hash_t function_hash;
+        int32_t      line;
+
+        bool operator==(const Source &) const = default;
+    };
+
+    struct SourceHash
+    {
+        size_t operator()(const Source &t_source) const
+        {
+            return std::hash<uint64_t>{}((static_cast<uint64_t>(t_source.file_hash) << 32 | t_source.function_hash) ^
+                                         static_cast<uint64_t>(t_source.line) * 0x9E3779B97F4A7C15ull);
+        }
+    };
+
+    // quantizable coordinates and float coordinates of each shape type
+    static constexpr std::array<size_t, kShapeCount> kQuantizedCount = {2, 0, 4, 4, 3, 6};
+    static constexpr std::array<size_t, kShapeCount> kFloatCount     = {0, 3, 0, 0, 0, 0};
+
+    static constexpr float kQuantizedMax   = std::numeric_limits<int16_t>::max();
+    static constexpr float kThicknessScale = 100.0f;
+
+    static Coordinates coordinates(const Shape &t_shape);
+    static Shape       shape(size_t t_type, const Coordinates &t_coordinates);
+
+    static uint32_t packColor(Color t_color);
+    static Color    unpackColor(uint32_t t_color);
+
+    uint8_t  colorIndex(uint32_t t_color);
+    uint16_t sourceIndex(const SourceLocation &t_source, StringTable *t_strings);
+
+    template <typename T>
+    void put(const T t_value)
+    {
+        const size_t offset = m_data.size();
+        m_data.resize(offset + sizeof(T));
+        std::memcpy(m_data.data() + offset, &t_value, sizeof(T));
+    }
+
+    std::vector<char> m_data;
+
+    std::vector<uint32_t>                            m_palette;
+    std::unordered_map<uint32_t, uint8_t>            m_palette_indices;
+    std::vector<Source>                              m_sources;
+    std::unordered_map<Source, uint16_t, SourceHash> m_source_indices;
+
+    // per draw, in the order of t_draws
+    std::vector<uint16_t>    m_draw_sources;
+    std::vector<uint8_t>     m_draw_colors;
+    std::vector<Coordinates> m_draw_coordinates;
+
+    // indices of the draws of each shape type
+    std::array<std::vector<uint32_t>, kShapeCount> m_order;
+};
+} // namespace Immortals::Common::Debug
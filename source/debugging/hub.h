@@ -2,6 +2,7 @@
 
 #include "color.h"
 #include "draw.h"
+#include "draw_batch.h"
 #include "source_location.h"
 #include "wrapper.h"
 
@@ -26,35 +27,59 @@ public:
         if (!config().common.enable_debug)
             return;
 
-        m_log_mutex.lock();
-        m_draw_mutex.lock();
-        m_execution_time_mutex.lock();
+        std::lock_guard flush_lock(m_flush_mutex);
 
-        m_wrapper.time = TimePoint::now();
+        {
+            std::lock_guard buffers_lock(m_buffers_mutex);
 
-        Protos::Immortals::Debug::Wrapper pb_wrapper;
-        m_wrapper.fillProto(&pb_wrapper);
+            // buffers of threads that have exited are dropped once they are drained
+            std::erase_if(m_buffers, [](const std::shared_ptr<ThreadBuffer> &t_buffer)
+                          { return t_buffer.use_count() == 1 && t_buffer->empty(); });
+
+            m_flush_buffers.assign(m_buffers.begin(), m_buffers.end());
+        }
 
-        m_wrapper.draws.clear();
+        for (const std::shared_ptr<ThreadBuffer> &buffer : m_flush_buffers)
+            collect(buffer.get());
+
+        m_flush_buffers.clear();
+
+        m_wrapper.time = TimePoint::now();
 
+        {
+            std::lock_guard lock(m_serializer_mutex);
+
+            // the serializer is still busy with an older frame, which is replaced except for its logs
+            if (m_pending_ready)
+            {
+                ++m_dropped_frames;
 #if FEATURE_LOGGING
-        m_wrapper.logs.clear();
+                m_wrapper.logs.insert(m_wrapper.logs.begin(), std::make_move_iterator(m_pending.logs.begin()),
+                                      std::make_move_iterator(m_pending.logs.end()));
 #endif
+            }
 
-        m_wrapper.execution_times.clear();
+            std::swap(m_wrapper, m_pending);
+            m_pending_ready = true;
+        }
 
-        m_log_mutex.unlock();
-        m_draw_mutex.unlock();
-        m_execution_time_mutex.unlock();
+        m_serializer_condition.notify_one();
 
-        m_server->send(m_wrapper.time, pb_wrapper);
+        clear(&m_wrapper);
+    }
+
+    // Frames the serializer thread fell too far behind to send
+    [[nodiscard]] size_t droppedFrames() const
+    {
+        std::lock_guard lock(m_serializer_mutex);
+        return m_dropped_frames;
     }
 
     void draw(Vec2 t_pos, const Color t_color = Color::black(), const float t_thickness = 10.0f,
-              const std::source_location &t_source = std::source_location::current())
+              const SourceLocation &t_source = SourceLocation::hashed(std::source_location::current()))
     {
         Draw draw{};
-        draw.source    = SourceLocation{t_source};
+        draw.source    = t_source;
         draw.shape     = t_pos;
         draw.color     = t_color;
         draw.thickness = t_thickness;
@@ -63,10 +88,10 @@ public:
     }
 
     void draw(const Line &t_line, const Color t_color = Color::black(), const float t_thickness = 10.0f,
-              const std::source_location &t_source = std::source_location::current())
+              const SourceLocation &t_source = SourceLocation::hashed(std::source_location::current()))
     {
         Draw draw{};
-        draw.source    = SourceLocation{t_source};
+        draw.source    = t_source;
         draw.shape     = t_line;
         draw.color     = t_color;
         draw.thickness = t_thickness;
@@ -75,10 +100,10 @@ public:
     }
 
     void draw(const LineSegment &t_line, const Color t_color = Color::black(), const float t_thickness = 10.0f,
-              const std::source_location &t_source = std::source_location::current())
+              const SourceLocation &t_source = SourceLocation::hashed(std::source_location::current()))
     {
         Draw draw{};
-        draw.source    = SourceLocation{t_source};
+        draw.source    = t_source;
         draw.shape     = t_line;
         draw.color     = t_color;
         draw.thickness = t_thickness;
@@ -87,10 +112,11 @@ public:
     }
 
     void draw(const Rect &t_rect, const Color t_color = Color::black(), const bool t_filled = true,
-              const float t_thickness = 10.0f, const std::source_location &t_source = std::source_location::current())
+              const float           t_thickness = 10.0f,
+              const SourceLocation &t_source    = SourceLocation::hashed(std::source_location::current()))
     {
         Draw draw{};
-        draw.source    = SourceLocation{t_source};
+        draw.source    = t_source;
         draw.shape     = t_rect;
         draw.color     = t_color;
         draw.filled    = t_filled;
@@ -100,10 +126,11 @@ public:
     }
 
     void draw(const Circle &t_circle, const Color t_color = Color::black(), const bool t_filled = true,
-              const float t_thickness = 10.0f, const std::source_location &t_source = std::source_location::current())
+              const float           t_thickness = 10.0f,
+              const SourceLocation &t_source    = SourceLocation::hashed(std::source_location::current()))
     {
         Draw draw{};
-        draw.source    = SourceLocation{t_source};
+        draw.source    = t_source;
         draw.shape     = t_circle;
         draw.color     = t_color;
         draw.filled    = t_filled;
@@ -113,10 +140,11 @@ public:
     }
 
     void draw(const Triangle &t_triangle, const Color t_color = Color::black(), const bool t_filled = true,
-              const float t_thickness = 10.0f, const std::source_location &t_source = std::source_location::current())
+              const float           t_thickness = 10.0f,
+              const SourceLocation &t_source    = SourceLocation::hashed(std::source_location::current()))
     {
         Draw draw{};
-        draw.source    = SourceLocation{t_source};
+        draw.source    = t_source;
         draw.shape     = t_triangle;
         draw.color     = t_color;
         draw.filled    = t_filled;
@@ -131,9 +159,7 @@ public:
         if (!config().common.enable_debug)
             return;
 
-        m_log_mutex.lock();
-        m_wrapper.logs.emplace_back(t_log);
-        m_log_mutex.unlock();
+        append([&t_log](Frame *const t_frame) { t_frame->logs.emplace_back(std::move(t_log)); });
     }
 #endif
 
@@ -142,9 +168,7 @@ public:
         if (!config().common.enable_debug)
             return;
 
-        m_draw_mutex.lock();
-        m_wrapper.draws.emplace_back(t_draw);
-        m_draw_mutex.unlock();
+        append([&t_draw](Frame *const t_frame) { t_frame->draws.emplace_back(std::move(t_draw)); });
     }
 
     void reportExecutionTime(const std::string_view t_name, const ExecutionTime &t_execution_time)
@@ -152,27 +176,230 @@ public:
         if (!config().common.enable_debug)
             return;
 
-        m_execution_time_mutex.lock();
-        m_wrapper.execution_times.emplace(t_name, t_execution_time);
-        m_execution_time_mutex.unlock();
+        append([t_name, &t_execution_time](Frame *const t_frame)
+               { t_frame->execution_times.emplace(t_name, t_execution_time); });
     }
 
 private:
+    // how often a frame carries all strings instead of only the ones new since the previous frame
+    static inline const Duration kKeyframeInterval = Duration::fromSeconds(1.0f);
+
+    struct Frame
+    {
+        std::vector<Draw> draws;
+
+#if FEATURE_LOGGING
+        std::vector<Log> logs;
+#endif
+
+        std::map<std::string, ExecutionTime> execution_times;
+    };
+
+    // Only its own thread appends to the active frame, while flush takes the other one.
+    // Flipping active and the busy flag work like a Dekker handshake, both sides use seq_cst for it.
+    struct ThreadBuffer
+    {
+        std::array<Frame, 2> frames;
+
+        std::atomic<unsigned> active = 0;
+        std::atomic<bool>     busy   = false;
+
+        bool empty() const
+        {
+            return std::all_of(frames.begin(), frames.end(),
+                               [](const Frame &t_frame)
+                               {
+                                   return t_frame.draws.empty() &&
+#if FEATURE_LOGGING
+                                          t_frame.logs.empty() &&
+#endif
+                                          t_frame.execution_times.empty();
+                               });
+        }
+    };
+
+    template <typename Append>
+    void append(Append &&t_append)
+    {
+        ThreadBuffer &buffer = threadBuffer();
+
+        buffer.busy.store(true);
+        t_append(&buffer.frames[buffer.active.load()]);
+        buffer.busy.store(false, std::memory_order_release);
+    }
+
+    ThreadBuffer &threadBuffer()
+    {
+        struct Local
+        {
+            const Hub *hub = nullptr;
+
+            std::shared_ptr<ThreadBuffer> buffer;
+        };
+
+        thread_local Local local;
+
+        // only the first append of every thread registers its buffer
+        if (local.hub != this)
+        {
+            local.hub    = this;
+            local.buffer = std::make_shared<ThreadBuffer>();
+
+            std::lock_guard lock(m_buffers_mutex);
+            m_buffers.push_back(local.buffer);
+        }
+
+        return *local.buffer;
+    }
+
+    // Moves the frame the thread was appending to into the wrapper
+    void collect(ThreadBuffer *const t_buffer)
+    {
+        const unsigned taken = t_buffer->active.load(std::memory_order_relaxed);
+        t_buffer->active.store(1 - taken);
+
+        // an append that still saw the old frame is at most a single emplace away
+        while (t_buffer->busy.load())
+            std::this_thread::yield();
+
+        Frame &frame = t_buffer->frames[taken];
+
+        m_wrapper.draws.insert(m_wrapper.draws.end(), std::make_move_iterator(frame.draws.begin()),
+                               std::make_move_iterator(frame.draws.end()));
+        frame.draws.clear();
+
+#if FEATURE_LOGGING
+        m_wrapper.logs.insert(m_wrapper.logs.end(), std::make_move_iterator(frame.logs.begin()),
+                              std::make_move_iterator(frame.logs.end()));
+        frame.logs.clear();
+#endif
+
+        m_wrapper.execution_times.merge(frame.execution_times);
+        frame.execution_times.clear();
+    }
+
+    static void clear(Wrapper *const t_wrapper)
+    {
+        t_wrapper->draws.clear();
+
+#if FEATURE_LOGGING
+        t_wrapper->logs.clear();
+#endif
+
+        t_wrapper->execution_times.clear();
+    }
+
+    // Encodes and sends the frames handed over by flush, so the thread calling flush doesn't pay for it.
+    // Together with the wrapper being filled and the pending one this triple buffers the frames.
+    void serialize()
+    {
+        setThreadName("DebugSerializer");
+
+        Wrapper                           wrapper;
+        Protos::Immortals::Debug::Wrapper pb_wrapper;
+
+        StringTable strings;
+        TimePoint   last_keyframe;
+
+        DrawBatch draw_batch;
+
+        while (true)
+        {
+            {
+                std::unique_lock lock(m_serializer_mutex);
+                m_serializer_condition.wait(lock, [this] { return m_pending_ready || m_stop; });
+
+                // the last frame is still sent when stopping
+                if (!m_pending_ready)
+                    return;
+
+                std::swap(wrapper, m_pending);
+                m_pending_ready = false;
+            }
+
+            // lets receivers that joined late, or a recording that's seeked into, resolve every string
+            const bool keyframe = wrapper.time - last_keyframe >= kKeyframeInterval;
+            if (keyframe)
+                last_keyframe = wrapper.time;
+
+            // the strings of the batched draws are added to the table before the wrapper sends them
+            if (m_draw_server != nullptr && draw_batch.encode(wrapper.draws, &strings))
+            {
+                const std::span<const char> data = draw_batch.data();
+
+                NngMessage message{data.size()};
+                if (message.data() != nullptr)
+                {
+                    *message.mutableTime() = wrapper.time.microseconds();
+                    std::memcpy(message.data(), data.data(), data.size());
+                    m_draw_server->sendRaw(std::move(message));
+                }
+
+                wrapper.draws.clear();
+            }
+
+            pb_wrapper.Clear();
+            wrapper.fillProto(&pb_wrapper, &strings, keyframe);
+
+            m_server->send(wrapper.time, pb_wrapper);
+
+            clear(&wrapper);
+        }
+    }
+
     Hub()
     {
         m_server = std::make_unique<NngServer>(config().network.debug_url);
+
+        if (!config().network.debug_draw_url.empty())
+            m_draw_server = std::make_unique<NngServer>(config().network.debug_draw_url);
+
+        m_serializer = std::thread(&Hub::serialize, this);
+    }
+
+    ~Hub()
+    {
+        stopSerializer();
     }
 
-    ~Hub() = default;
+    // Sends the last pending frame and joins the serializer thread. Called by Services::shutdown before
+    // the logger and the config it uses are gone, frames flushed afterwards are no longer sent.
+    void stopSerializer()
+    {
+        {
+            std::lock_guard lock(m_serializer_mutex);
+            m_stop = true;
+        }
+
+        m_serializer_condition.notify_one();
+
+        if (m_serializer.joinable())
+            m_serializer.join();
+    }
 
     friend struct ::Immortals::Common::Services;
 
     std::unique_ptr<NngServer> m_server;
+    std::unique_ptr<NngServer> m_draw_server;
+
+    // only touched by flush
+    Wrapper    m_wrapper;
+    std::mutex m_flush_mutex;
+
+    std::vector<std::shared_ptr<ThreadBuffer>> m_buffers;
+    std::vector<std::shared_ptr<ThreadBuffer>> m_flush_buffers;
+
+    std::mutex m_buffers_mutex;
+
+    // handed from flush to the serializer thread
+    Wrapper m_pending;
+    bool    m_pending_ready  = false;
+    bool    m_stop           = false;
+    size_t  m_dropped_frames = 0;
 
-    Wrapper m_wrapper;
+    mutable std::mutex      m_serializer_mutex;
+    std::condition_variable m_serializer_condition;
 
-    std::mutex m_log_mutex;
-    std::mutex m_draw_mutex;
-    std::mutex m_execution_time_mutex;
+    std::thread m_serializer;
 };
 } // namespace Immortals::Common::Debug
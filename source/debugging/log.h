@@ -24,7 +24,7 @@ struct Log
 
     Log() = default;
 
-    Log(const Protos::Immortals::Debug::Log &t_log, const StringMap &t_strings)
+    Log(const Protos::Immortals::Debug::Log &t_log, const StringTable &t_strings)
     {
         level  = static_cast<Level>(t_log.level());
         source = SourceLocation{t_log.source(), t_strings};
@@ -38,7 +38,7 @@ struct Log
         text   = {t_msg.payload.data(), t_msg.payload.size()};
     }
 
-    void fillProto(Protos::Immortals::Debug::Log *t_log, StringMap *t_strings) const
+    void fillProto(Protos::Immortals::Debug::Log *t_log, StringTable *t_strings) const
     {
         t_log->set_level(static_cast<Protos::Immortals::Debug::Log_Level>(level));
         source.fillProto(t_log->mutable_source(), t_strings);
@@ -1,53 +1,182 @@
 #pragma once
 
+#include "string_table.h"
+
+// Compilers implementing CWG2631 evaluate immediate invocations in default arguments at the call site,
+// older ones do it where the default argument is declared, which would give every draw the same location.
+// On those (gcc 12 and 13, older clang and msvc) a draw only stores the two pointers and the line, and the
+// hashes are looked up later by whoever encodes it, once per use through a per-thread cache of the literals.
+#if (defined(__clang__) && !defined(__apple_build_version__) && __clang_major__ >= 17) ||                              \
+    (defined(__apple_build_version__) && __clang_major__ >= 16) ||                                                     \
+    (defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 14)
+#define SOURCE_CONSTEVAL consteval
+#else
+#define SOURCE_CONSTEVAL constexpr
+#endif
+
 namespace Immortals::Common::Debug
 {
-using StringMap = std::unordered_map<XXH32_hash_t, std::string>;
-
 struct SourceLocation
 {
     std::string_view file;
     std::string_view function;
     int              line;
 
+    // only valid when has_hashes is set, otherwise file and function are string literals hashed on use
+    XXH32_hash_t file_hash     = 0;
+    XXH32_hash_t function_hash = 0;
+    bool         has_hashes    = false;
+
     SourceLocation() = default;
 
-    explicit SourceLocation(const std::source_location &t_source)
+    // Implicit so a std::source_location can still be passed on to Hub::draw
+    constexpr SourceLocation(const std::source_location &t_source)
+        : file(t_source.file_name()), function(t_source.function_name()), line(static_cast<int>(t_source.line()))
     {
-        file     = t_source.file_name();
-        function = t_source.function_name();
-        line     = t_source.line();
+        if (std::is_constant_evaluated())
+        {
+            file_hash     = hash(file);
+            function_hash = hash(function);
+            has_hashes    = true;
+        }
+    }
+
+    // Meant as a default argument, so the hashes are computed at compile time where supported
+    // and a draw only stores them: SourceLocation::hashed(std::source_location::current())
+    static SOURCE_CONSTEVAL SourceLocation hashed(const std::source_location t_source)
+    {
+        return SourceLocation{t_source};
     }
 
 #if FEATURE_LOGGING
     explicit SourceLocation(const spdlog::source_loc &t_source)
     {
-        file     = t_source.filename;
-        function = t_source.funcname;
+        // spdlog leaves them null when the log call has no source information
+        const char *const filename = t_source.filename != nullptr ? t_source.filename : "";
+        const char *const funcname = t_source.funcname != nullptr ? t_source.funcname : "";
+
+        file     = filename;
+        function = funcname;
         line     = t_source.line;
     }
 #endif
-    
-    SourceLocation(const Protos::Immortals::Debug::SourceLocation &t_source, const StringMap &t_strings)
+
+    SourceLocation(const Protos::Immortals::Debug::SourceLocation &t_source, const StringTable &t_strings)
     {
-        file     = t_strings.at(t_source.file());
-        function = t_strings.at(t_source.function());
+        file_hash     = t_source.file();
+        function_hash = t_source.function();
+        has_hashes    = true;
+
+        file     = t_strings.get(file_hash);
+        function = t_strings.get(function_hash);
         line     = t_source.line();
     }
 
-    void fillProto(Protos::Immortals::Debug::SourceLocation *t_source, StringMap *t_strings) const
+    void fillProto(Protos::Immortals::Debug::SourceLocation *t_source, StringTable *t_strings) const
     {
-        const XXH32_hash_t file_hash     = XXH32(file.data(), file.size(), 0);
-        const XXH32_hash_t function_hash = XXH32(function.data(), function.size(), 0);
-
-        t_source->set_file(file_hash);
-        t_source->set_function(function_hash);
+        t_source->set_file(fileHash());
+        t_source->set_function(functionHash());
         t_source->set_line(line);
 
-        if (!t_strings->contains(file_hash))
-            t_strings->try_emplace(file_hash, std::string{file.data(), file.size()});
-        if (!t_strings->contains(function_hash))
-            t_strings->emplace(function_hash, std::string{function.data(), function.size()});
+        t_strings->add(fileHash(), file);
+        t_strings->add(functionHash(), function);
+    }
+
+    XXH32_hash_t fileHash() const
+    {
+        return has_hashes ? file_hash : hashLiteral(file);
+    }
+
+    XXH32_hash_t functionHash() const
+    {
+        return has_hashes ? function_hash : hashLiteral(function);
+    }
+
+    // Same result as XXH32 with a zero seed
+    static constexpr XXH32_hash_t hash(const std::string_view t_string)
+    {
+        constexpr uint32_t kPrime1 = 0x9E3779B1u;
+        constexpr uint32_t kPrime2 = 0x85EBCA77u;
+        constexpr uint32_t kPrime3 = 0xC2B2AE3Du;
+        constexpr uint32_t kPrime4 = 0x27D4EB2Fu;
+        constexpr uint32_t kPrime5 = 0x165667B1u;
+
+        const auto round = [](const uint32_t t_acc, const uint32_t t_input)
+        { return rotl(t_acc + t_input * kPrime2, 13) * kPrime1; };
+
+        const size_t size   = t_string.size();
+        size_t       offset = 0;
+        uint32_t     result = 0;
+
+        if (size >= 16)
+        {
+            uint32_t v1 = kPrime1 + kPrime2;
+            uint32_t v2 = kPrime2;
+            uint32_t v3 = 0;
+            uint32_t v4 = 0 - kPrime1;
+
+            for (; offset + 16 <= size; offset += 16)
+            {
+                v1 = round(v1, read32(t_string, offset));
+                v2 = round(v2, read32(t_string, offset + 4));
+                v3 = round(v3, read32(t_string, offset + 8));
+                v4 = round(v4, read32(t_string, offset + 12));
+            }
+
+            result = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        }
+        else
+        {
+            result = kPrime5;
+        }
+
+        result += static_cast<uint32_t>(size);
+
+        for (; offset + 4 <= size; offset += 4)
+            result = rotl(result + read32(t_string, offset) * kPrime3, 17) * kPrime4;
+
+        for (; offset < size; ++offset)
+            result = rotl(result + static_cast<unsigned char>(t_string[offset]) * kPrime5, 11) * kPrime1;
+
+        result ^= result >> 15;
+        result *= kPrime2;
+        result ^= result >> 13;
+        result *= kPrime3;
+        result ^= result >> 16;
+
+        return result;
+    }
+
+private:
+    static constexpr uint32_t rotl(const uint32_t t_value, const int t_bits)
+    {
+        return (t_value << t_bits) | (t_value >> (32 - t_bits));
+    }
+
+    // little endian, like XXH32 on every platform
+    static constexpr uint32_t read32(const std::string_view t_string, const size_t t_offset)
+    {
+        return static_cast<uint32_t>(static_cast<unsigned char>(t_string[t_offset])) |
+               static_cast<uint32_t>(static_cast<unsigned char>(t_string[t_offset + 1])) << 8 |
+               static_cast<uint32_t>(static_cast<unsigned char>(t_string[t_offset + 2])) << 16 |
+               static_cast<uint32_t>(static_cast<unsigned char>(t_string[t_offset + 3])) << 24;
+    }
+
+    // The names in std::source_location and spdlog::source_loc are string literals,
+    // so each thread only hashes them the first time it sees them
+    static XXH32_hash_t hashLiteral(const std::string_view t_string)
+    {
+        thread_local std::unordered_map<const char *, XXH32_hash_t> hashes;
+
+        const auto [it, inserted] = hashes.try_emplace(t_string.data(), 0);
+        if (inserted)
+            it->second = XXH32(t_string.data(), t_string.size(), 0);
+
+        return it->second;
     }
 };
+
+static_assert(SourceLocation::hash("") == 0x02CC5D05u);
+static_assert(SourceLocation::hash("abc") == 0x32D153FFu);
+static_assert(SourceLocation::hash("Nobody inspects the spammish repetition") == 0xE2293B2Fu);
 } // namespace Immortals::Common::Debug
@@ -0,0 +1,67 @@
+#pragma once
+
+namespace Immortals::Common::Debug
+{
+using StringMap = std::unordered_map<XXH32_hash_t, std::string>;
+
+// The strings of the source locations in a debug stream, keyed by their XXH32 hash.
+// A sender only puts the strings its receivers haven't seen yet in a frame, and all of them in a keyframe,
+// while a receiver keeps them across frames. Entries are never removed, so views into them stay valid.
+class StringTable
+{
+public:
+    // Remembers t_string to be sent with the next frame, unless it's known already
+    void add(const XXH32_hash_t t_hash, const std::string_view t_string)
+    {
+        if (m_strings.try_emplace(t_hash, t_string).second)
+            m_fresh.emplace_back(t_hash);
+    }
+
+    // Returns an empty string for hashes whose string wasn't received, e.g. before the first keyframe
+    std::string_view get(const XXH32_hash_t t_hash) const
+    {
+        const auto it = m_strings.find(t_hash);
+        return it != m_strings.end() ? std::string_view{it->second} : std::string_view{};
+    }
+
+    // Fills the strings added since the last call, or all of them for a keyframe
+    void fillProto(Protos::Immortals::Debug::Wrapper *t_wrapper, const bool t_keyframe)
+    {
+        auto *const strings = t_wrapper->mutable_strings();
+
+        if (t_keyframe)
+        {
+            for (const auto &entry : m_strings)
+                strings->emplace(entry.first, entry.second);
+        }
+        else
+        {
+            for (const XXH32_hash_t hash : m_fresh)
+                strings->emplace(hash, m_strings.at(hash));
+        }
+
+        m_fresh.clear();
+    }
+
+    void merge(const Protos::Immortals::Debug::Wrapper &t_wrapper)
+    {
+        for (const auto &entry : t_wrapper.strings())
+            m_strings.try_emplace(entry.first, entry.second);
+    }
+
+    const StringMap &strings() const
+    {
+        return m_strings;
+    }
+
+    size_t size() const
+    {
+        return m_strings.size();
+    }
+
+private:
+    StringMap m_strings;
+
+    std::vector<XXH32_hash_t> m_fresh;
+};
+} // namespace Immortals::Common::Debug
@@ -19,19 +19,24 @@ struct Wrapper
     std::vector<Log> logs;
 #endif
 
-    StringMap strings;
+    // only used when the wrapper isn't given a table shared with other frames of its stream
+    StringTable strings;
 
     std::map<std::string, ExecutionTime> execution_times;
 
     Wrapper() = default;
 
-    explicit Wrapper(const Protos::Immortals::Debug::Wrapper &t_wrapper)
+    // Only resolves the strings carried by the frame itself, which is enough for keyframes
+    explicit Wrapper(const Protos::Immortals::Debug::Wrapper &t_wrapper) : Wrapper(t_wrapper, &strings)
+    {}
+
+    // Merges the strings of the frame into t_strings, which keeps them for the frames that follow.
+    // The source locations point into t_strings, so it must outlive the wrapper.
+    Wrapper(const Protos::Immortals::Debug::Wrapper &t_wrapper, StringTable *t_strings)
     {
         time = TimePoint::fromMicroseconds(t_wrapper.time());
 
-        strings.reserve(t_wrapper.strings().size());
-        for (const auto &entry : t_wrapper.strings())
-            strings.emplace(entry.first, entry.second);
+        t_strings->merge(t_wrapper);
 
         draws.reserve(t_wrapper.draw_size());
 
@@ -40,31 +45,37 @@ struct Wrapper
 #endif
 
         for (const auto &draw : t_wrapper.draw())
-            draws.emplace_back(draw, strings);
+            draws.emplace_back(draw, *t_strings);
 
 #if FEATURE_LOGGING
         for (const auto &log : t_wrapper.log())
-            logs.emplace_back(log, strings);
+            logs.emplace_back(log, *t_strings);
 #endif
 
         for (const auto &execution_time : t_wrapper.execution_times())
             execution_times.emplace(execution_time.first, execution_time.second);
     }
 
+    // Self-contained frame with every string it refers to
     void fillProto(Protos::Immortals::Debug::Wrapper *t_wrapper)
+    {
+        fillProto(t_wrapper, &strings, true);
+    }
+
+    // Only carries the strings new to t_strings, unless it's a keyframe
+    void fillProto(Protos::Immortals::Debug::Wrapper *t_wrapper, StringTable *t_strings, const bool t_keyframe) const
     {
         t_wrapper->set_time(time.microseconds());
 
         for (const auto &draw : draws)
-            draw.fillProto(t_wrapper->add_draw(), &strings);
+            draw.fillProto(t_wrapper->add_draw(), t_strings);
 
 #if FEATURE_LOGGING
         for (const auto &log : logs)
-            log.fillProto(t_wrapper->add_log(), &strings);
+            log.fillProto(t_wrapper->add_log(), t_strings);
 #endif
 
-        for (const auto &entry : strings)
-            t_wrapper->mutable_strings()->emplace(entry.first, entry.second);
+        t_strings->fillProto(t_wrapper, t_keyframe);
 
         for (const auto &execution_time : execution_times)
             execution_time.second.fillProto(&(*t_wrapper->mutable_execution_times())[execution_time.first]);
@@ -2,8 +2,21 @@
 
 namespace Immortals::Common
 {
-NngClient::NngClient(const std::string_view t_url)
+NngClient::NngClient(const std::string_view t_url, const std::initializer_list<std::string_view> t_topics)
 {
+    if (ShmRing::isShmUrl(t_url))
+    {
+        m_shm = std::make_unique<ShmRing>();
+        m_shm->open(t_url);
+
+        if (t_topics.size() == 0)
+            m_shm->subscribe("");
+
+        for (const std::string_view topic : t_topics)
+            subscribe(topic);
+        return;
+    }
+
     int result;
 
     result = nng_sub_open(&m_socket);
@@ -12,13 +25,18 @@ NngClient::NngClient(const std::string_view t_url)
         logCritical("Failed to open nng sub socket: {}", nng_strerror(result));
     }
 
-    // TODO: take filter as an input
-    result = nng_socket_set(m_socket, NNG_OPT_SUB_SUBSCRIBE, "", 0);
-    if (result != 0)
+    if (t_topics.size() == 0)
     {
-        logCritical("Failed to set nng socket subscribe filter: {}", nng_strerror(result));
+        result = nng_socket_set(m_socket, NNG_OPT_SUB_SUBSCRIBE, "", 0);
+        if (result != 0)
+        {
+            logCritical("Failed to set nng socket subscribe filter: {}", nng_strerror(result));
+        }
     }
 
+    for (const std::string_view topic : t_topics)
+        subscribe(topic);
+
     const std::string url_null_terminated{t_url.data(), t_url.size()};
     result = nng_dial(m_socket, url_null_terminated.c_str(), &m_dialer, NNG_FLAG_NONBLOCK);
     if (result != 0)
@@ -27,6 +45,41 @@ NngClient::NngClient(const std::string_view t_url)
     }
 }
 
+NngClient::~NngClient()
+{
+    stopAsync();
+}
+
+NngClient::NngClient(NngClient &&t_other) noexcept
+    : m_socket(t_other.m_socket), m_dialer(t_other.m_dialer), m_topics(t_other.m_topics),
+      m_subscriptions(std::move(t_other.m_subscriptions)), m_mailboxes(std::move(t_other.m_mailboxes)),
+      m_receive_timeout(t_other.m_receive_timeout), m_async(std::move(t_other.m_async)),
+      m_shm(std::move(t_other.m_shm))
+{
+    t_other.m_mailboxes.clear();
+}
+
+NngClient &NngClient::operator=(NngClient &&t_other) noexcept
+{
+    if (this != &t_other)
+    {
+        // the callback must be gone before the mailboxes it writes to
+        stopAsync();
+
+        m_socket          = t_other.m_socket;
+        m_dialer          = t_other.m_dialer;
+        m_topics          = t_other.m_topics;
+        m_subscriptions   = std::move(t_other.m_subscriptions);
+        m_mailboxes       = std::move(t_other.m_mailboxes);
+        m_receive_timeout = t_other.m_receive_timeout;
+        m_async           = std::move(t_other.m_async);
+        m_shm             = std::move(t_other.m_shm);
+
+        t_other.m_mailboxes.clear();
+    }
+    return *this;
+}
+
 bool NngClient::receive(google::protobuf::MessageLite *const t_message, TimePoint *const t_time, const bool t_drain)
 {
     const NngMessage message = receiveRaw(t_drain);
@@ -42,30 +95,314 @@ bool NngClient::receive(google::protobuf::MessageLite *const t_message, TimePoin
 
 NngMessage NngClient::receiveRaw(const bool t_drain)
 {
-    char  *buffer = nullptr;
-    size_t size   = 0;
+    if (m_shm != nullptr)
+        return wrap(m_shm->read(t_drain), m_topics);
+
+    NngMessage message;
 
     do
     {
-        char  *new_buffer = nullptr;
-        size_t new_size   = 0;
+        nng_msg *new_message = nullptr;
 
-        const int result = nng_recv(m_socket, &new_buffer, &new_size, NNG_FLAG_ALLOC | NNG_FLAG_NONBLOCK);
+        const int result = nng_recvmsg(m_socket, &new_message, NNG_FLAG_NONBLOCK);
         if (result != 0)
         {
             if (result != NNG_EAGAIN)
                 logCritical("Failed to receive from nng sub socket: {}", nng_strerror(result));
             break;
         }
-        else
+
+        // frees the older message when draining
+        message = wrap(new_message, m_topics);
+    }
+    while (t_drain);
+
+    return message;
+}
+
+bool NngClient::receive(google::protobuf::MessageLite *const t_message, const Duration t_timeout,
+                        TimePoint *const t_time)
+{
+    const NngMessage message = receiveRaw(t_timeout);
+
+    if (message.size() == 0)
+        return false;
+
+    if (t_time != nullptr)
+        *t_time = message.time();
+
+    return t_message->ParseFromArray(message.data(), message.size());
+}
+
+NngMessage NngClient::receiveRaw(const Duration t_timeout)
+{
+    if (m_shm != nullptr)
+    {
+        // there is nothing to block on in shared memory
+        const TimePoint deadline = TimePoint::now() + t_timeout;
+        while (true)
         {
-            buffer = new_buffer;
-            size   = new_size;
+            NngMessage message = wrap(m_shm->read(false), m_topics);
+            if (message.size() > 0 || TimePoint::now() >= deadline)
+                return message;
+
+            std::this_thread::sleep_for(kShmPollInterval);
         }
     }
-    while (t_drain);
 
-    return {buffer, size};
+    constexpr uint64_t kMaxTimeout = std::numeric_limits<nng_duration>::max();
+
+    const nng_duration timeout = static_cast<nng_duration>(std::min(t_timeout.milliseconds(), kMaxTimeout));
+
+    if (timeout != m_receive_timeout)
+    {
+        const int result = nng_socket_set_ms(m_socket, NNG_OPT_RECVTIMEO, timeout);
+        if (result != 0)
+        {
+            logError("Failed to set nng receive timeout: {}", nng_strerror(result));
+            return {};
+        }
+
+        m_receive_timeout = timeout;
+    }
+
+    nng_msg *message = nullptr;
+
+    const int result = nng_recvmsg(m_socket, &message, 0);
+    if (result != 0)
+    {
+        if (result != NNG_ETIMEDOUT)
+            logCritical("Failed to receive from nng sub socket: {}", nng_strerror(result));
+        return {};
+    }
+
+    return wrap(message, m_topics);
+}
+
+bool NngClient::receiveAsync(Callback t_callback)
+{
+    if (m_async != nullptr)
+    {
+        logError("Async nng receive is already running");
+        return false;
+    }
+
+    if (m_shm != nullptr)
+    {
+        logError("Async receive is not available on shared memory");
+        return false;
+    }
+
+    auto async = std::make_unique<Async>();
+    async->socket   = m_socket;
+    async->topics   = m_topics;
+    async->callback = std::move(t_callback);
+
+    const int result = nng_aio_alloc(&async->aio, &NngClient::onReceive, async.get());
+    if (result != 0)
+    {
+        logError("Failed to allocate nng aio: {}", nng_strerror(result));
+        return false;
+    }
+
+    m_async = std::move(async);
+
+    nng_recv_aio(m_async->socket, m_async->aio);
+    return true;
+}
+
+void NngClient::stopAsync()
+{
+    if (m_async == nullptr)
+        return;
+
+    // also waits for the callback and keeps it from submitting again
+    nng_aio_stop(m_async->aio);
+    nng_aio_free(m_async->aio);
+
+    m_async.reset();
+}
+
+void NngClient::onReceive(void *const t_async)
+{
+    Async *const async = static_cast<Async *>(t_async);
+
+    const int result = nng_aio_result(async->aio);
+
+    // stopped, either by stopAsync or by the socket closing
+    if (result == NNG_ECANCELED || result == NNG_ECLOSED)
+        return;
+
+    if (async->retrying)
+    {
+        async->retrying = false;
+        nng_recv_aio(async->socket, async->aio);
+        return;
+    }
+
+    if (result != 0)
+    {
+        // a receive timeout set for the synchronous receive applies here too, and isn't an error
+        if (result != NNG_ETIMEDOUT)
+        {
+            logError("Failed to receive from nng sub socket, retrying: {}", nng_strerror(result));
+            async->errors.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        async->retrying = true;
+        nng_sleep_aio(kAsyncRetryInterval, async->aio);
+        return;
+    }
+
+    NngMessage message = wrap(nng_aio_get_msg(async->aio), async->topics);
+    if (message.size() > 0)
+        async->callback(std::move(message));
+
+    nng_recv_aio(async->socket, async->aio);
+}
+
+bool NngClient::subscribe(const std::string_view t_topic)
+{
+    if (!setFilter(true, t_topic))
+        return false;
+
+    m_topics = true;
+    m_subscriptions.emplace_back(t_topic);
+    return true;
+}
+
+bool NngClient::unsubscribe(const std::string_view t_topic)
+{
+    if (!setFilter(false, t_topic))
+        return false;
+
+    const auto it = std::find(m_subscriptions.begin(), m_subscriptions.end(), t_topic);
+    if (it != m_subscriptions.end())
+        m_subscriptions.erase(it);
+    return true;
+}
+
+bool NngClient::startMailbox()
+{
+    if (!m_mailboxes.empty())
+    {
+        logError("Nng mailbox is already running");
+        return false;
+    }
+
+    if (!m_topics)
+    {
+        m_mailboxes.emplace_back("");
+    }
+    else
+    {
+        for (const std::string &topic : m_subscriptions)
+            m_mailboxes.emplace_back(topic);
+    }
+
+    // the client may move, but the mailboxes don't
+    std::vector<Mailbox *> mailboxes;
+    for (Mailbox &mailbox : m_mailboxes)
+        mailboxes.push_back(&mailbox);
+
+    const bool result = receiveAsync(
+        [mailboxes = std::move(mailboxes)](NngMessage &&t_message)
+        {
+            const std::string_view topic = t_message.topic();
+
+            // messages of the "" subscription keep their own topic, which may not have a mailbox
+            Mailbox *target = nullptr;
+            for (Mailbox *const mailbox : mailboxes)
+            {
+                if (mailbox->topic == topic)
+                {
+                    target = mailbox;
+                    break;
+                }
+                if (mailbox->topic.empty())
+                    target = mailbox;
+            }
+
+            if (target == nullptr)
+                return;
+
+            nng_msg *const stale = target->message.exchange(t_message.detach(), std::memory_order_acq_rel);
+            if (stale != nullptr)
+                nng_msg_free(stale);
+        });
+
+    if (!result)
+        m_mailboxes.clear();
+
+    return result;
+}
+
+NngMessage NngClient::takeLatest(const std::string_view t_topic)
+{
+    for (Mailbox &mailbox : m_mailboxes)
+    {
+        if (mailbox.topic == t_topic)
+            return wrap(mailbox.message.exchange(nullptr, std::memory_order_acq_rel), m_topics);
+    }
+
+    return {};
+}
+
+bool NngClient::takeLatest(google::protobuf::MessageLite *const t_message, TimePoint *const t_time,
+                           const std::string_view t_topic)
+{
+    const NngMessage message = takeLatest(t_topic);
+
+    if (message.size() == 0)
+        return false;
+
+    if (t_time != nullptr)
+        *t_time = message.time();
+
+    return t_message->ParseFromArray(message.data(), message.size());
+}
+
+bool NngClient::setFilter(const bool t_subscribe, const std::string_view t_topic)
+{
+    if (t_topic.size() > NngMessage::kMaxTopicSize)
+    {
+        logError("Nng topic \"{}\" is too long", t_topic);
+        return false;
+    }
+
+    std::array<char, NngMessage::kMaxTopicSize + 1> filter;
+    std::memcpy(filter.data(), t_topic.data(), t_topic.size());
+    filter[t_topic.size()] = '\0';
+
+    // an empty filter matches everything
+    const size_t size = t_topic.empty() ? 0 : t_topic.size() + 1;
+
+    if (m_shm != nullptr)
+    {
+        if (t_subscribe)
+            m_shm->subscribe({filter.data(), size});
+        else
+            m_shm->unsubscribe({filter.data(), size});
+        return true;
+    }
+
+    const char *const option = t_subscribe ? NNG_OPT_SUB_SUBSCRIBE : NNG_OPT_SUB_UNSUBSCRIBE;
+
+    const int result = nng_socket_set(m_socket, option, filter.data(), size);
+    if (result != 0)
+    {
+        logError("Failed to set nng socket filter \"{}\": {}", t_topic, nng_strerror(result));
+        return false;
+    }
+
+    return true;
 }
 
+NngMessage NngClient::wrap(nng_msg *const t_message, const bool t_topics)
+{
+    if (t_message == nullptr)
+        return {};
+
+    return t_topics ? NngMessage::withTopic(t_message) : NngMessage{t_message};
+}
 } // namespace Immortals::Common
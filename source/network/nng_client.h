@@ -2,20 +2,138 @@
 
 #include "../time/time_point.h"
 #include "nng_message.h"
+#include "shm_ring.h"
 
 namespace Immortals::Common
 {
 class NngClient
 {
 public:
-    NngClient(std::string_view t_url);
+    using Callback = std::function<void(NngMessage &&t_message)>;
+
+    // Without topics everything is received and messages are expected without a topic prefix,
+    // otherwise only the given topics are, and an empty topic subscribes to all of them.
+    // shm:// urls read from the shared memory ring of a server on the same host.
+    NngClient(std::string_view t_url, std::initializer_list<std::string_view> t_topics = {});
+    ~NngClient();
+
+    NngClient(const NngClient &)            = delete;
+    NngClient &operator=(const NngClient &) = delete;
+
+    // Asynchronous receive and the mailboxes keep running in the moved to client
+    NngClient(NngClient &&t_other) noexcept;
+    NngClient &operator=(NngClient &&t_other) noexcept;
 
     bool receive(google::protobuf::MessageLite *t_message, TimePoint *t_time = nullptr, bool t_drain = false);
 
     NngMessage receiveRaw(bool t_drain = false);
 
+    // Blocks until a message arrives or t_timeout passes
+    bool receive(google::protobuf::MessageLite *t_message, Duration t_timeout, TimePoint *t_time = nullptr);
+
+    NngMessage receiveRaw(Duration t_timeout);
+
+    // Calls t_callback on an nng thread as soon as each message arrives, until stopAsync.
+    // Topics should be subscribed before it's started. Not available on shm:// urls.
+    bool receiveAsync(Callback t_callback);
+
+    template <typename Message>
+    bool receiveAsync(std::function<void(const Message &, TimePoint)> t_callback)
+    {
+        return receiveAsync(
+            [message = Message{}, callback = std::move(t_callback)](NngMessage &&t_message) mutable
+            {
+                if (!message.ParseFromArray(t_message.data(), t_message.size()))
+                {
+                    logWarning("Failed to parse the received nng message");
+                    return;
+                }
+
+                callback(message, t_message.time());
+            });
+    }
+
+    // Waits for a running callback to return
+    void stopAsync();
+
+    // Receive errors of the asynchronous receive, which is retried after each of them
+    [[nodiscard]] size_t asyncErrors() const
+    {
+        return m_async != nullptr ? m_async->errors.load(std::memory_order_relaxed) : 0;
+    }
+
+    bool subscribe(std::string_view t_topic);
+    bool unsubscribe(std::string_view t_topic);
+
+    // Keeps only the newest message of every subscribed topic, received in the background, so a slow
+    // consumer never goes through the stale ones. Topics should be subscribed before it's started.
+    bool startMailbox();
+
+    // Takes the newest message of t_topic that arrived since the last call, empty if there is none
+    NngMessage takeLatest(std::string_view t_topic = {});
+    bool       takeLatest(google::protobuf::MessageLite *t_message, TimePoint *t_time = nullptr,
+                          std::string_view t_topic = {});
+
 private:
+    // Lives on the heap so the client can still be moved while receiving
+    struct Async
+    {
+        nng_socket socket;
+        nng_aio   *aio    = nullptr;
+        bool       topics = false;
+
+        // the aio is sleeping before receiving again after an error
+        bool retrying = false;
+
+        std::atomic<size_t> errors = 0;
+
+        Callback callback;
+    };
+
+    static void onReceive(void *t_async);
+
+    struct Mailbox
+    {
+        explicit Mailbox(const std::string_view t_topic) : topic(t_topic)
+        {}
+
+        ~Mailbox()
+        {
+            if (nng_msg *const stale = message.load(std::memory_order_acquire); stale != nullptr)
+                nng_msg_free(stale);
+        }
+
+        std::string topic;
+
+        std::atomic<nng_msg *> message = nullptr;
+    };
+
+    static NngMessage wrap(nng_msg *t_message, bool t_topics);
+
+    // the filter is the topic and its terminator, so a topic doesn't match longer ones it is a prefix of
+    bool setFilter(bool t_subscribe, std::string_view t_topic);
+
+    static constexpr std::chrono::microseconds kShmPollInterval{100};
+
+    // keeps a persistent receive error from spinning the nng thread
+    static constexpr nng_duration kAsyncRetryInterval = 10;
+
     nng_socket m_socket;
     nng_dialer m_dialer;
+
+    bool m_topics = false;
+
+    std::vector<std::string> m_subscriptions;
+
+    // a deque so the mailboxes stay in place for the receiver
+    std::deque<Mailbox> m_mailboxes;
+
+    // only set on the socket when it changes
+    nng_duration m_receive_timeout = NNG_DURATION_DEFAULT;
+
+    std::unique_ptr<Async> m_async;
+
+    // set instead of the socket for shm:// urls
+    std::unique_ptr<ShmRing> m_shm;
 };
 } // namespace Immortals::Common
@@ -4,53 +4,160 @@
 
 namespace Immortals::Common
 {
+// Owns an nng_msg laid out as [uint64_t timestamp][payload], or [topic\0][uint64_t timestamp][payload]
+// when it has a topic, as subscriptions filter on the start of the message.
+// Sending moves the nng_msg into the socket, so the payload is never copied on the way.
 struct NngMessage
 {
-    NngMessage() : NngMessage(nullptr, 0)
-    {}
+    static constexpr size_t kMaxTopicSize = 255;
 
-    NngMessage(const size_t t_size)
-        : NngMessage(static_cast<char *>(nng_alloc(t_size + sizeof(uint64_t))), t_size + sizeof(uint64_t))
-    {}
+    NngMessage() = default;
+
+    explicit NngMessage(const size_t t_size, const std::string_view t_topic = {})
+    {
+        if (!validTopic(t_topic))
+            return;
+
+        const size_t offset = t_topic.empty() ? 0 : t_topic.size() + 1;
+
+        const int result = nng_msg_alloc(&m_message, offset + sizeof(uint64_t) + t_size);
+        if (result != 0)
+        {
+            logError("Failed to allocate nng message of {} bytes: {}", t_size, nng_strerror(result));
+            m_message = nullptr;
+            return;
+        }
+
+        if (offset > 0)
+        {
+            std::memcpy(body(), t_topic.data(), t_topic.size());
+            body()[t_topic.size()] = '\0';
+        }
+
+        m_offset = offset;
+    }
 
     ~NngMessage()
     {
-        if (m_data.data() != nullptr)
+        reset();
+    }
+
+    NngMessage(const NngMessage &)            = delete;
+    NngMessage &operator=(const NngMessage &) = delete;
+
+    NngMessage(NngMessage &&t_other) noexcept
+        : m_message(std::exchange(t_other.m_message, nullptr)), m_offset(std::exchange(t_other.m_offset, 0))
+    {}
+
+    NngMessage &operator=(NngMessage &&t_other) noexcept
+    {
+        if (this != &t_other)
         {
-            nng_free(m_data.data(), m_data.size());
+            reset();
+            m_message = std::exchange(t_other.m_message, nullptr);
+            m_offset  = std::exchange(t_other.m_offset, 0);
         }
+        return *this;
     }
 
-    NngMessage(const NngMessage &) = delete;
+    static bool validTopic(const std::string_view t_topic)
+    {
+        if (t_topic.size() > kMaxTopicSize || t_topic.find('\0') != std::string_view::npos)
+        {
+            logError("Invalid nng message topic \"{}\"", t_topic);
+            return false;
+        }
+        return true;
+    }
+
+    std::string_view topic() const
+    {
+        return m_offset > 0 ? std::string_view{body(), m_offset - 1} : std::string_view{};
+    }
 
     TimePoint time() const
     {
-        const uint64_t timestamp = m_data.size() >= sizeof(uint64_t) ? *((uint64_t *) m_data.data()) : 0;
+        uint64_t timestamp = 0;
+        if (valid())
+            std::memcpy(&timestamp, body() + m_offset, sizeof(timestamp));
         return TimePoint::fromMicroseconds(timestamp);
     }
 
     uint64_t *mutableTime()
     {
-        return m_data.size() >= sizeof(uint64_t) ? (uint64_t *) m_data.data() : nullptr;
+        return valid() ? reinterpret_cast<uint64_t *>(body() + m_offset) : nullptr;
     }
 
     char *data() const
     {
-        return m_data.data() != nullptr ? m_data.data() + sizeof(uint64_t) : nullptr;
+        return valid() ? body() + m_offset + sizeof(uint64_t) : nullptr;
     }
 
     size_t size() const
     {
-        return m_data.size() >= sizeof(uint64_t) ? m_data.size() - sizeof(uint64_t) : 0;
+        return valid() ? length() - m_offset - sizeof(uint64_t) : 0;
     }
 
 private:
-    NngMessage(char *const t_buffer, const size_t t_size) : m_data(t_buffer, t_size)
+    explicit NngMessage(nng_msg *const t_message, const size_t t_offset = 0)
+        : m_message(t_message), m_offset(t_offset)
     {}
 
+    // Takes a received message that starts with a topic
+    static NngMessage withTopic(nng_msg *const t_message)
+    {
+        NngMessage message{t_message};
+
+        const size_t length = std::min(message.length(), kMaxTopicSize + 1);
+        const void  *end    = std::memchr(message.body(), '\0', length);
+        if (end == nullptr)
+        {
+            logWarning("Dropped nng message without a topic");
+            return {};
+        }
+
+        message.m_offset = static_cast<const char *>(end) - message.body() + 1;
+        return message;
+    }
+
+    bool valid() const
+    {
+        return length() >= m_offset + sizeof(uint64_t);
+    }
+
+    char *body() const
+    {
+        return static_cast<char *>(nng_msg_body(m_message));
+    }
+
+    size_t length() const
+    {
+        return m_message != nullptr ? nng_msg_len(m_message) : 0;
+    }
+
+    void reset()
+    {
+        if (m_message != nullptr)
+        {
+            nng_msg_free(m_message);
+            m_message = nullptr;
+        }
+        m_offset = 0;
+    }
+
+    // Hands the ownership of the nng_msg to the caller
+    nng_msg *detach()
+    {
+        m_offset = 0;
+        return std::exchange(m_message, nullptr);
+    }
+
     friend class NngClient;
     friend class NngServer;
 
-    std::span<char> m_data;
+    nng_msg *m_message = nullptr;
+
+    // size of the topic prefix, including its terminator
+    size_t m_offset = 0;
 };
 } // namespace Immortals::Common
@@ -4,6 +4,13 @@ namespace Immortals::Common
 {
 NngServer::NngServer(const std::string_view t_url)
 {
+    if (ShmRing::isShmUrl(t_url))
+    {
+        m_shm = std::make_unique<ShmRing>();
+        m_shm->create(t_url);
+        return;
+    }
+
     int result;
 
     result = nng_pub_open(&m_socket);
@@ -21,30 +28,98 @@ NngServer::NngServer(const std::string_view t_url)
     }
 }
 
-bool NngServer::send(const TimePoint &t_time, const google::protobuf::MessageLite &t_message)
+bool NngServer::send(const TimePoint &t_time, const google::protobuf::MessageLite &t_message,
+                     const std::string_view t_topic)
 {
-    NngMessage message{t_message.ByteSizeLong()};
+    const size_t size = t_message.ByteSizeLong();
+
+    if (m_shm != nullptr)
+    {
+        if (!NngMessage::validTopic(t_topic))
+            return false;
+
+        // same layout as NngMessage, serialized straight into the ring
+        const size_t offset = t_topic.empty() ? 0 : t_topic.size() + 1;
+
+        char *const data = m_shm->beginWrite(offset + sizeof(uint64_t) + size);
+        if (data == nullptr)
+            return false;
+
+        if (offset > 0)
+        {
+            std::memcpy(data, t_topic.data(), t_topic.size());
+            data[t_topic.size()] = '\0';
+        }
+
+        const uint64_t timestamp = t_time.microseconds();
+        std::memcpy(data + offset, &timestamp, sizeof(timestamp));
+
+        t_message.SerializeWithCachedSizesToArray(reinterpret_cast<uint8_t *>(data + offset + sizeof(timestamp)));
+
+        m_shm->endWrite();
+        return true;
+    }
+
+    NngMessage message{size, t_topic};
+    if (message.mutableTime() == nullptr)
+        return false;
 
     *message.mutableTime() = t_time.microseconds();
 
-    if (!t_message.SerializeToArray(message.data(), message.size()))
+    t_message.SerializeWithCachedSizesToArray(reinterpret_cast<uint8_t *>(message.data()));
+
+    return sendRaw(std::move(message));
+}
+
+bool NngServer::sendRaw(NngMessage &&t_message)
+{
+    if (t_message.m_message == nullptr)
+        return false;
+
+    if (m_shm != nullptr)
+        return sendRaw(static_cast<const NngMessage &>(t_message));
+
+    const size_t size = t_message.length();
+
+    nng_msg *const message = t_message.detach();
+
+    const int result = nng_sendmsg(m_socket, message, 0);
+    if (result != 0)
     {
-        logError("Failed to serializeToArray (Maybe need to adjust Setting::kMaxUdpPacketSize)");
+        // nng only takes the message when it succeeds
+        nng_msg_free(message);
+
+        logError("Nng send of {} bytes failed: {}", size, nng_strerror(result));
         return false;
     }
 
-    return sendRaw(message);
+    return true;
 }
 
 bool NngServer::sendRaw(const NngMessage &t_message)
 {
-    const int result = nng_send(m_socket, t_message.m_data.data(), t_message.m_data.size(), 0);
+    if (t_message.m_message == nullptr)
+        return false;
+
+    if (m_shm != nullptr)
+    {
+        char *const data = m_shm->beginWrite(t_message.length());
+        if (data == nullptr)
+            return false;
+
+        std::memcpy(data, t_message.body(), t_message.length());
+        m_shm->endWrite();
+        return true;
+    }
+
+    nng_msg  *copy   = nullptr;
+    const int result = nng_msg_dup(&copy, t_message.m_message);
     if (result != 0)
     {
-        logError("Nng send of {} bytes failed: {}", t_message.m_data.size(), nng_strerror(result));
+        logError("Failed to copy nng message of {} bytes: {}", t_message.length(), nng_strerror(result));
         return false;
     }
 
-    return true;
+    return sendRaw(NngMessage{copy});
 }
 } // namespace Immortals::Common
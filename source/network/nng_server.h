@@ -2,21 +2,31 @@
 
 #include "../time/time_point.h"
 #include "nng_message.h"
+#include "shm_ring.h"
 
 namespace Immortals::Common
 {
 class NngServer
 {
 public:
+    // shm:// urls publish to a shared memory ring instead, for consumers on the same host
     NngServer(std::string_view t_url);
 
-    // Serializes the protobuf message to the internal buffer and sends it
-    bool send(const TimePoint &t_time, const google::protobuf::MessageLite &t_message);
+    // Serializes the protobuf message to the internal buffer and sends it.
+    // A socket can carry several streams under different topics, but then every message needs one.
+    bool send(const TimePoint &t_time, const google::protobuf::MessageLite &t_message, std::string_view t_topic = {});
 
+    // Moves the message into the socket without copying it
+    bool sendRaw(NngMessage &&t_message);
+
+    // Sends a copy of the message, prefer moving it in when it isn't needed afterwards
     bool sendRaw(const NngMessage &t_message);
 
 private:
     nng_socket   m_socket;
     nng_listener m_listener;
+
+    // set instead of the socket for shm:// urls
+    std::unique_ptr<ShmRing> m_shm;
 };
 } // namespace Immortals::Common
@@ -0,0 +1,314 @@
+#include "shm_ring.h"
+
+namespace Immortals::Common
+{
+struct ShmRing::Header
+{
+    static constexpr uint32_t kMagic   = 0x494d5348; // "IMSH"
+    static constexpr uint32_t kVersion = 1;
+
+    // written last by the producer, so a consumer never sees a half initialized ring
+    std::atomic<uint32_t> magic;
+    uint32_t              version;
+
+    uint32_t slot_count;
+    uint32_t slot_size;
+
+    // set when the producer goes away, consumers then reopen the name to find its successor
+    std::atomic<bool> closed;
+
+    alignas(64) std::atomic<uint64_t> write_index;
+};
+
+struct ShmRing::Slot
+{
+    // odd while the slot is written, 2 * (index + 1) once message index is complete
+    std::atomic<uint64_t> sequence;
+    uint64_t              size;
+
+    char *data()
+    {
+        return reinterpret_cast<char *>(this + 1);
+    }
+};
+
+// the ring is shared between processes, so the atomics must not fall back to a lock inside one of them
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+size_t ShmRing::slotStride(const uint32_t t_slot_size)
+{
+    const size_t size = sizeof(Slot) + t_slot_size;
+    return (size + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+size_t ShmRing::headerSize()
+{
+    return (sizeof(Header) + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+static std::string shmName(const std::string_view t_url)
+{
+    return "/" + std::string{t_url.substr(ShmRing::kUrlScheme.size())};
+}
+
+ShmRing::~ShmRing()
+{
+    if (m_owner && m_header != nullptr)
+        m_header->closed.store(true, std::memory_order_release);
+
+    detach();
+
+#if defined(__linux__) || defined(__APPLE__)
+    if (m_owner)
+        shm_unlink(m_name.c_str());
+#endif
+}
+
+bool ShmRing::create(const std::string_view t_url, const uint32_t t_slot_count, const uint32_t t_slot_size)
+{
+#if defined(__linux__) || defined(__APPLE__)
+    if (t_slot_count == 0)
+    {
+        logCritical("Shared memory ring \"{}\" needs at least one slot", t_url);
+        return false;
+    }
+
+    m_name  = shmName(t_url);
+    m_owner = true;
+
+    // consumers of a previous producer keep their mapping until they notice it's closed
+    shm_unlink(m_name.c_str());
+
+    const int fd = shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (fd < 0)
+    {
+        logCritical("Failed to create shared memory \"{}\": {}", m_name, std::strerror(errno));
+        return false;
+    }
+
+    m_size = headerSize() + slotStride(t_slot_size) * t_slot_count;
+
+    if (ftruncate(fd, static_cast<off_t>(m_size)) != 0)
+    {
+        logCritical("Failed to size shared memory \"{}\" to {} bytes: {}", m_name, m_size, std::strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    void *const memory = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (memory == MAP_FAILED)
+    {
+        logCritical("Failed to map shared memory \"{}\": {}", m_name, std::strerror(errno));
+        return false;
+    }
+
+    // ftruncate zero fills, which is a valid state for every field
+    m_header             = static_cast<Header *>(memory);
+    m_header->version    = Header::kVersion;
+    m_header->slot_count = t_slot_count;
+    m_header->slot_size  = t_slot_size;
+    m_header->magic.store(Header::kMagic, std::memory_order_release);
+
+    m_index = 0;
+    return true;
+#else
+    logCritical("Shared memory transport is not supported on this platform ({})", t_url);
+    return false;
+#endif
+}
+
+char *ShmRing::beginWrite(const size_t t_size)
+{
+    if (m_header == nullptr)
+        return nullptr;
+
+    if (t_size > m_header->slot_size)
+    {
+        logError("Message of {} bytes doesn't fit the {} byte slots of \"{}\"", t_size, m_header->slot_size, m_name);
+        return nullptr;
+    }
+
+    m_index        = m_header->write_index.load(std::memory_order_relaxed);
+    m_pending_size = t_size;
+
+    Slot *const slot = this->slot(m_index);
+    slot->sequence.store(2 * m_index + 1, std::memory_order_relaxed);
+    // keeps the data writes after the odd sequence
+    std::atomic_thread_fence(std::memory_order_release);
+
+    return slot->data();
+}
+
+void ShmRing::endWrite()
+{
+    Slot *const slot = this->slot(m_index);
+    slot->size       = m_pending_size;
+    slot->sequence.store(2 * (m_index + 1), std::memory_order_release);
+
+    m_header->write_index.store(m_index + 1, std::memory_order_release);
+}
+
+void ShmRing::open(const std::string_view t_url)
+{
+    m_name  = shmName(t_url);
+    m_owner = false;
+}
+
+void ShmRing::subscribe(const std::string_view t_filter)
+{
+    m_filters.emplace_back(t_filter);
+}
+
+void ShmRing::unsubscribe(const std::string_view t_filter)
+{
+    const auto it = std::find(m_filters.begin(), m_filters.end(), t_filter);
+    if (it != m_filters.end())
+        m_filters.erase(it);
+}
+
+nng_msg *ShmRing::read(const bool t_drain)
+{
+    if (m_header == nullptr && !attach())
+        return nullptr;
+
+    const uint64_t written = m_header->write_index.load(std::memory_order_acquire);
+
+    if (m_index >= written)
+    {
+        if (m_header->closed.load(std::memory_order_acquire))
+            detach();
+        return nullptr;
+    }
+
+    if (written - m_index > m_header->slot_count)
+    {
+        m_skipped += written - m_index - m_header->slot_count;
+        m_index = written - m_header->slot_count;
+    }
+
+    if (t_drain)
+    {
+        // only the newest matching message is copied, the rest is passed over
+        nng_msg *message = nullptr;
+        for (uint64_t index = written; message == nullptr && index-- > m_index;)
+            message = copy(index);
+
+        m_index = written;
+        return message;
+    }
+
+    while (m_index < written)
+    {
+        if (nng_msg *const message = copy(m_index++); message != nullptr)
+            return message;
+    }
+
+    return nullptr;
+}
+
+nng_msg *ShmRing::copy(const uint64_t t_index)
+{
+    const uint64_t expected = 2 * (t_index + 1);
+
+    Slot *const slot = this->slot(t_index);
+    if (slot->sequence.load(std::memory_order_acquire) != expected)
+    {
+        // overwritten since write_index was read
+        ++m_skipped;
+        return nullptr;
+    }
+
+    const size_t size = std::min<size_t>(slot->size, m_header->slot_size);
+    if (!matches({slot->data(), size}))
+        return nullptr;
+
+    nng_msg *message = nullptr;
+    if (const int result = nng_msg_alloc(&message, size); result != 0)
+    {
+        logError("Failed to allocate nng message of {} bytes: {}", size, nng_strerror(result));
+        return nullptr;
+    }
+
+    std::memcpy(nng_msg_body(message), slot->data(), size);
+
+    // the copy is only valid if the producer didn't start on the slot meanwhile
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot->sequence.load(std::memory_order_relaxed) != expected)
+    {
+        nng_msg_free(message);
+        ++m_skipped;
+        return nullptr;
+    }
+
+    return message;
+}
+
+bool ShmRing::attach()
+{
+#if defined(__linux__) || defined(__APPLE__)
+    const int fd = shm_open(m_name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+
+    struct stat status;
+    if (fstat(fd, &status) != 0 || static_cast<size_t>(status.st_size) < headerSize())
+    {
+        close(fd);
+        return false;
+    }
+
+    m_size = status.st_size;
+
+    void *const memory = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (memory == MAP_FAILED)
+    {
+        logError("Failed to map shared memory \"{}\": {}", m_name, std::strerror(errno));
+        return false;
+    }
+
+    m_header = static_cast<Header *>(memory);
+
+    const bool ready = m_header->magic.load(std::memory_order_acquire) == Header::kMagic &&
+                       m_header->version == Header::kVersion &&
+                       headerSize() + slotStride(m_header->slot_size) * m_header->slot_count <= m_size;
+    if (!ready)
+    {
+        detach();
+        return false;
+    }
+
+    m_index = m_header->write_index.load(std::memory_order_acquire);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void ShmRing::detach()
+{
+#if defined(__linux__) || defined(__APPLE__)
+    if (m_header != nullptr)
+        munmap(m_header, m_size);
+#endif
+
+    m_header = nullptr;
+    m_size   = 0;
+}
+
+ShmRing::Slot *ShmRing::slot(const uint64_t t_index) const
+{
+    char *const base = reinterpret_cast<char *>(m_header) + headerSize();
+    return reinterpret_cast<Slot *>(base + slotStride(m_header->slot_size) * (t_index % m_header->slot_count));
+}
+
+bool ShmRing::matches(const std::string_view t_data) const
+{
+    return std::any_of(m_filters.begin(), m_filters.end(),
+                       [t_data](const std::string &t_filter) { return t_data.starts_with(t_filter); });
+}
+} // namespace Immortals::Common
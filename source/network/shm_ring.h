@@ -0,0 +1,85 @@
+#pragma once
+
+namespace Immortals::Common
+{
+// Single producer, multiple consumer ring of messages in POSIX shared memory, behind the shm:// urls
+// of NngServer and NngClient. Slots hold the same bytes as an NngMessage and are guarded by a
+// sequence number, so the producer never waits: a consumer that falls a whole ring behind skips ahead.
+class ShmRing
+{
+public:
+    static constexpr std::string_view kUrlScheme = "shm://";
+
+    static constexpr uint32_t kDefaultSlotCount = 64;
+    static constexpr uint32_t kDefaultSlotSize  = 256 * 1024;
+
+    ShmRing() = default;
+    ~ShmRing();
+
+    ShmRing(const ShmRing &)            = delete;
+    ShmRing &operator=(const ShmRing &) = delete;
+
+    static bool isShmUrl(const std::string_view t_url)
+    {
+        return t_url.starts_with(kUrlScheme);
+    }
+
+    // Producer side, replaces any ring left behind under the same name
+    bool create(std::string_view t_url, uint32_t t_slot_count = kDefaultSlotCount,
+                uint32_t t_slot_size = kDefaultSlotSize);
+
+    // Returns where to write t_size bytes, which are visible to consumers after endWrite
+    char *beginWrite(size_t t_size);
+    void  endWrite();
+
+    // Consumer side, can be called before the producer exists, as the ring is only opened when first read.
+    // Consumers start at the newest message, like a subscriber that just connected.
+    void open(std::string_view t_url);
+
+    // Same semantics as the nng sub filters: a message is read if it starts with any of them
+    void subscribe(std::string_view t_filter);
+    void unsubscribe(std::string_view t_filter);
+
+    // Copies the next matching message into a new nng_msg, or returns nullptr if there is none
+    nng_msg *read(bool t_drain);
+
+    // Messages overwritten before this consumer got to them
+    [[nodiscard]] size_t skipped() const
+    {
+        return m_skipped;
+    }
+
+private:
+    struct Header;
+    struct Slot;
+
+    static constexpr size_t kAlignment = 64;
+
+    static size_t headerSize();
+    static size_t slotStride(uint32_t t_slot_size);
+
+    bool attach();
+    void detach();
+
+    Slot *slot(uint64_t t_index) const;
+
+    // Copies message t_index if it still holds and matches the filters
+    nng_msg *copy(uint64_t t_index);
+
+    bool matches(std::string_view t_data) const;
+
+    std::string m_name;
+    bool        m_owner = false;
+
+    Header *m_header = nullptr;
+    size_t  m_size   = 0;
+
+    // producer: index of the message being written, consumer: index of the next message to read
+    uint64_t m_index        = 0;
+    size_t   m_pending_size = 0;
+
+    std::vector<std::string> m_filters;
+
+    size_t m_skipped = 0;
+};
+} // namespace Immortals::Common
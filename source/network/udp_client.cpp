@@ -2,6 +2,28 @@
 
 namespace Immortals::Common
 {
+#if defined(__linux__)
+static TimePoint kernelTime(const msghdr &t_header)
+{
+    for (const cmsghdr *control = CMSG_FIRSTHDR(&t_header); control != nullptr;
+         control = CMSG_NXTHDR(const_cast<msghdr *>(&t_header), const_cast<cmsghdr *>(control)))
+    {
+        if (control->cmsg_level != SOL_SOCKET || control->cmsg_type != SCM_TIMESTAMPNS)
+            continue;
+
+        timespec time;
+        std::memcpy(&time, CMSG_DATA(control), sizeof(time));
+
+        const auto since_epoch = std::chrono::seconds{time.tv_sec} + std::chrono::nanoseconds{time.tv_nsec};
+        return {std::chrono::system_clock::time_point{
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(since_epoch)}};
+    }
+
+    // timestamping is not available on this socket
+    return TimePoint::now();
+}
+#endif
+
 UdpClient::UdpClient(const NetworkAddress &t_address)
 {
     m_context = std::make_unique<asio::io_context>();
@@ -10,8 +32,23 @@ UdpClient::UdpClient(const NetworkAddress &t_address)
     updateAddress(t_address);
 }
 
+UdpClient::UdpClient(const NetworkAddress &t_address, UdpContext &t_context)
+{
+    m_shared_context = &t_context.context();
+    m_socket         = std::make_unique<asio::ip::udp::socket>(*m_shared_context);
+
+    updateAddress(t_address);
+}
+
+UdpClient::~UdpClient()
+{
+    stopAsync();
+}
+
 void UdpClient::updateAddress(const NetworkAddress &t_address)
 {
+    stopAsync();
+
     if (m_socket->is_open())
     {
         m_socket->close();
@@ -28,19 +65,53 @@ void UdpClient::updateAddress(const NetworkAddress &t_address)
         m_socket->set_option(asio::ip::multicast::join_group(m_address));
     }
     m_socket->non_blocking(true);
+
+#if defined(__linux__)
+    const int enable = 1;
+    if (setsockopt(m_socket->native_handle(), SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) != 0)
+        logWarning("Failed to enable udp receive timestamps: {}", std::strerror(errno));
+#endif
 }
 
-bool UdpClient::receive(google::protobuf::MessageLite *const t_message)
+bool UdpClient::receive(google::protobuf::MessageLite *const t_message, TimePoint *const t_time)
 {
     std::span<char> data;
-    if (!receiveRaw(&data))
+    if (!receiveRaw(&data, t_time))
         return false;
 
     return t_message->ParseFromArray(data.data(), data.size());
 }
 
-bool UdpClient::receiveRaw(std::span<char> *const t_data)
+bool UdpClient::receiveRaw(std::span<char> *const t_data, TimePoint *const t_time)
 {
+#if defined(__linux__)
+    sockaddr_storage address;
+    iovec            vector{.iov_base = m_buffer.data(), .iov_len = m_buffer.size()};
+    Control          control;
+
+    msghdr header{};
+    header.msg_name       = &address;
+    header.msg_namelen    = sizeof(address);
+    header.msg_iov        = &vector;
+    header.msg_iovlen     = 1;
+    header.msg_control    = control.data();
+    header.msg_controllen = control.size();
+
+    const ssize_t received_size = recvmsg(m_socket->native_handle(), &header, MSG_DONTWAIT);
+
+    if (received_size < 0)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            logError("Udp receive failed with [{}]: {}", errno, std::strerror(errno));
+        return false;
+    }
+
+    std::memcpy(m_last_receive_endpoint.data(), &address, header.msg_namelen);
+    m_last_receive_endpoint.resize(header.msg_namelen);
+
+    if (t_time != nullptr)
+        *t_time = kernelTime(header);
+#else
     asio::error_code error;
 
     const size_t received_size = m_socket->receive_from(asio::buffer(m_buffer), m_last_receive_endpoint, 0, error);
@@ -52,8 +123,206 @@ bool UdpClient::receiveRaw(std::span<char> *const t_data)
         return false;
     }
 
+    if (t_time != nullptr)
+        *t_time = TimePoint::now();
+#endif
+
     *t_data = std::span<char>(m_buffer.data(), received_size);
     return true;
 }
 
+bool UdpClient::receiveAsync(Callback t_callback)
+{
+    if (m_shared_context == nullptr)
+    {
+        logError("Async udp receive needs a client created on a shared context");
+        return false;
+    }
+
+    if (m_async_token != nullptr)
+    {
+        logError("Async udp receive is already running");
+        return false;
+    }
+
+    m_callback    = std::move(t_callback);
+    m_async_token = std::make_shared<bool>(true);
+
+    if (m_retry_timer == nullptr)
+        m_retry_timer = std::make_unique<asio::steady_timer>(*m_shared_context);
+
+    // the socket is not thread safe, so even the first wait is started on the context thread
+    asio::post(*m_shared_context,
+               [this, token = m_async_token]
+               {
+                   if (*token)
+                       waitAsync(token);
+               });
+
+    return true;
+}
+
+void UdpClient::waitAsync(const std::shared_ptr<bool> &t_token)
+{
+    m_socket->async_wait(asio::ip::udp::socket::wait_read,
+                         [this, token = t_token](const asio::error_code &t_error)
+                         {
+                             if (!*token)
+                                 return;
+
+                             // the socket was cancelled or closed without stopAsync
+                             if (t_error == asio::error::operation_aborted)
+                                 return;
+
+                             if (t_error)
+                             {
+                                 logError("Udp wait failed with [{}]: {}", t_error.value(), t_error.message());
+
+                                 m_async_errors.fetch_add(1, std::memory_order_relaxed);
+                                 retryAsync(token);
+                                 return;
+                             }
+
+                             std::span<char> data;
+                             TimePoint       time;
+                             while (*token && receiveRaw(&data, &time))
+                                 m_callback(data, time);
+
+                             if (*token)
+                                 waitAsync(token);
+                         });
+}
+
+void UdpClient::retryAsync(const std::shared_ptr<bool> &t_token)
+{
+    m_retry_timer->expires_after(kAsyncRetryInterval);
+    m_retry_timer->async_wait(
+        [this, token = t_token](const asio::error_code &t_error)
+        {
+            if (*token && !t_error)
+                waitAsync(token);
+        });
+}
+
+void UdpClient::stopAsync()
+{
+    if (m_async_token == nullptr)
+        return;
+
+    const auto stop = [this]
+    {
+        *m_async_token = false;
+        m_socket->cancel();
+        m_retry_timer->cancel();
+    };
+
+    if (m_shared_context->stopped() || m_shared_context->get_executor().running_in_this_thread())
+    {
+        stop();
+    }
+    else
+    {
+        std::promise<void> stopped;
+        asio::post(*m_shared_context,
+                   [&]
+                   {
+                       stop();
+                       stopped.set_value();
+                   });
+        stopped.get_future().wait();
+    }
+
+    m_async_token.reset();
+}
+
+void UdpClient::prepareBatch()
+{
+    m_batch_buffers.resize(kMaxBatchSize);
+
+#if defined(__linux__)
+    for (size_t i = 0; i < kMaxBatchSize; ++i)
+    {
+        m_batch_vectors[i].iov_base = m_batch_buffers[i].data();
+        m_batch_vectors[i].iov_len  = m_batch_buffers[i].size();
+
+        m_batch_headers[i].msg_hdr.msg_iovlen = 1;
+    }
+#endif
+}
+
+bool UdpClient::receiveBatch(std::vector<Datagram> *const t_datagrams)
+{
+    t_datagrams->clear();
+
+    if (m_batch_buffers.empty())
+        prepareBatch();
+
+#if defined(__linux__)
+    // the kernel overwrites the lengths with what it actually received,
+    // the pointers are set every time as they point into this object
+    for (size_t i = 0; i < kMaxBatchSize; ++i)
+    {
+        msghdr &header        = m_batch_headers[i].msg_hdr;
+        header.msg_name       = &m_batch_addresses[i];
+        header.msg_iov        = &m_batch_vectors[i];
+        header.msg_namelen    = sizeof(sockaddr_storage);
+        header.msg_control    = m_batch_controls[i].data();
+        header.msg_controllen = m_batch_controls[i].size();
+        header.msg_flags      = 0;
+    }
+
+    const int count =
+        recvmmsg(m_socket->native_handle(), m_batch_headers.data(), kMaxBatchSize, MSG_DONTWAIT, nullptr);
+
+    if (count < 0)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            logError("Udp batch receive failed with [{}]: {}", errno, std::strerror(errno));
+        return false;
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        const msghdr &header = m_batch_headers[i].msg_hdr;
+
+        if ((header.msg_flags & MSG_TRUNC) != 0)
+            logWarning("Udp datagram truncated to {} bytes", m_batch_buffers[i].size());
+
+        Datagram &datagram = t_datagrams->emplace_back();
+        datagram.data      = std::span<char>(m_batch_buffers[i].data(), m_batch_headers[i].msg_len);
+        datagram.time      = kernelTime(header);
+
+        std::memcpy(datagram.endpoint.data(), header.msg_name, header.msg_namelen);
+        datagram.endpoint.resize(header.msg_namelen);
+    }
+#else
+    for (Buffer &buffer : m_batch_buffers)
+    {
+        asio::error_code        error;
+        asio::ip::udp::endpoint endpoint;
+
+        const size_t received_size = m_socket->receive_from(asio::buffer(buffer), endpoint, 0, error);
+
+        if (error)
+        {
+            if (error != asio::error::would_block)
+                logError("Udp receive failed with [{}]: {}", error.value(), error.message());
+            break;
+        }
+
+        t_datagrams->push_back({
+            .data     = std::span<char>(buffer.data(), received_size),
+            .endpoint = endpoint,
+            .time     = TimePoint::now(),
+        });
+    }
+#endif
+
+    if (t_datagrams->empty())
+        return false;
+
+    m_last_receive_endpoint = t_datagrams->back().endpoint;
+    return true;
+}
+
 } // namespace Immortals::Common
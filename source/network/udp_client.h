@@ -1,19 +1,108 @@
 #pragma once
 
 #include "../config/config.h"
+#include "udp_context.h"
 
 namespace Immortals::Common
 {
 class UdpClient
 {
 public:
+    // A received datagram, the data points into the buffers of the client
+    // and is only valid until the next receive call
+    struct Datagram
+    {
+        std::span<char>         data;
+        asio::ip::udp::endpoint endpoint;
+        TimePoint               time;
+    };
+
+    template <typename Message>
+    struct Received
+    {
+        Message   message;
+        TimePoint time;
+    };
+
+    using Callback = std::function<void(std::span<const char> t_data, TimePoint t_time)>;
+
+    static constexpr size_t kMaxBatchSize = 16;
+
     explicit UdpClient(const NetworkAddress &t_address);
 
+    // The socket is served by the thread of t_context, which lets it receive asynchronously
+    UdpClient(const NetworkAddress &t_address, UdpContext &t_context);
+
+    ~UdpClient();
+
+    UdpClient(const UdpClient &)            = delete;
+    UdpClient &operator=(const UdpClient &) = delete;
+
+    // Also stops receiving asynchronously
     void updateAddress(const NetworkAddress &t_address);
 
-    bool receive(google::protobuf::MessageLite *t_message);
+    // t_time is set to when the kernel received the datagram where supported, otherwise to when it was read
+    bool receive(google::protobuf::MessageLite *t_message, TimePoint *t_time = nullptr);
+
+    bool receiveRaw(std::span<char> *t_data, TimePoint *t_time = nullptr);
+
+    // Receives all pending datagrams, up to kMaxBatchSize, in a single recvmmsg call on linux
+    bool receiveBatch(std::vector<Datagram> *t_datagrams);
+
+    // Calls t_callback on the context thread for every datagram as soon as it arrives, until stopAsync.
+    // The data is only valid during the call. Needs a client created on a shared context.
+    bool receiveAsync(Callback t_callback);
+
+    template <typename Message>
+    bool receiveAsync(std::function<void(const Message &, TimePoint)> t_callback)
+    {
+        return receiveAsync(
+            [message = Message{}, callback = std::move(t_callback)](const std::span<const char> t_data,
+                                                                    const TimePoint t_time) mutable
+            {
+                if (!message.ParseFromArray(t_data.data(), t_data.size()))
+                {
+                    logWarning("Failed to parse the received udp message");
+                    return;
+                }
+
+                callback(message, t_time);
+            });
+    }
+
+    // Hands the parsed messages to a consumer thread, they are dropped while the queue is full
+    template <typename Message>
+    bool receiveAsync(SpscQueue<Received<Message>> *t_queue)
+    {
+        return receiveAsync(
+            [this, t_queue](const std::span<const char> t_data, const TimePoint t_time)
+            {
+                Received<Message> received;
+                received.time = t_time;
+                if (!received.message.ParseFromArray(t_data.data(), t_data.size()))
+                {
+                    logWarning("Failed to parse the received udp message");
+                    return;
+                }
+
+                if (!t_queue->push(std::move(received)))
+                    m_async_dropped.fetch_add(1, std::memory_order_relaxed);
+            });
+    }
+
+    // Waits until no callback is running, so the client can be destroyed right after
+    void stopAsync();
+
+    [[nodiscard]] size_t asyncDropped() const
+    {
+        return m_async_dropped.load(std::memory_order_relaxed);
+    }
 
-    bool receiveRaw(std::span<char> *t_data);
+    // Wait errors of the asynchronous receive, which is retried after each of them
+    [[nodiscard]] size_t asyncErrors() const
+    {
+        return m_async_errors.load(std::memory_order_relaxed);
+    }
 
     [[nodiscard]] NetworkAddress getListenEndpoint() const
     {
@@ -41,9 +130,45 @@ private:
 
     asio::ip::udp::endpoint m_last_receive_endpoint;
 
+    // only owned when the client is not on a shared context
     std::unique_ptr<asio::io_context>      m_context;
     std::unique_ptr<asio::ip::udp::socket> m_socket;
 
+    void waitAsync(const std::shared_ptr<bool> &t_token);
+    void retryAsync(const std::shared_ptr<bool> &t_token);
+
+    // pause before waiting again after an error, so a lasting one doesn't turn into a busy loop
+    static constexpr std::chrono::milliseconds kAsyncRetryInterval{10};
+
+    asio::io_context *m_shared_context = nullptr;
+
+    Callback m_callback;
+
+    // only touched on the context thread, handlers check it before using the client as it may be gone by then
+    std::shared_ptr<bool> m_async_token;
+
+    std::unique_ptr<asio::steady_timer> m_retry_timer;
+
+    std::atomic<size_t> m_async_dropped = 0;
+    std::atomic<size_t> m_async_errors  = 0;
+
     std::array<char, Config::Network::kMaxUdpPacketSize> m_buffer = {};
+
+    void prepareBatch();
+
+    using Buffer = std::array<char, Config::Network::kMaxUdpPacketSize>;
+
+    // allocated on the first batch receive, so clients that never use it don't pay for it
+    std::vector<Buffer> m_batch_buffers;
+
+#if defined(__linux__)
+    // enough for a single SCM_TIMESTAMPNS message
+    using Control = std::array<char, CMSG_SPACE(sizeof(timespec))>;
+
+    std::array<mmsghdr, kMaxBatchSize>          m_batch_headers   = {};
+    std::array<iovec, kMaxBatchSize>            m_batch_vectors   = {};
+    std::array<sockaddr_storage, kMaxBatchSize> m_batch_addresses = {};
+    std::array<Control, kMaxBatchSize>          m_batch_controls  = {};
+#endif
 };
 } // namespace Immortals::Common
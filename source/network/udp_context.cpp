@@ -0,0 +1,25 @@
+#include "udp_context.h"
+
+namespace Immortals::Common
+{
+UdpContext::UdpContext()
+{
+    m_thread = std::thread(&UdpContext::run, this);
+}
+
+UdpContext::~UdpContext()
+{
+    m_work.reset();
+    m_context.stop();
+
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+void UdpContext::run()
+{
+    Debug::setThreadName("UdpContext");
+
+    m_context.run();
+}
+} // namespace Immortals::Common
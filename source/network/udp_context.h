@@ -0,0 +1,31 @@
+#pragma once
+
+namespace Immortals::Common
+{
+// Runs a single io_context on a dedicated thread, shared by any number of asynchronous udp clients.
+// The clients must be destroyed before the context.
+class UdpContext
+{
+public:
+    UdpContext();
+    ~UdpContext();
+
+    UdpContext(const UdpContext &)            = delete;
+    UdpContext &operator=(const UdpContext &) = delete;
+
+    asio::io_context &context()
+    {
+        return m_context;
+    }
+
+private:
+    void run();
+
+    asio::io_context m_context;
+
+    // keeps run() from returning while no client is waiting
+    asio::executor_work_guard<asio::io_context::executor_type> m_work = asio::make_work_guard(m_context);
+
+    std::thread m_thread;
+};
+} // namespace Immortals::Common
@@ -9,27 +9,215 @@ UdpServer::UdpServer()
     m_socket = std::make_unique<asio::ip::udp::socket>(*m_context, asio::ip::udp::v4());
 }
 
+bool UdpServer::resolve(const NetworkAddress &t_address, Destination *const t_destination)
+{
+    asio::error_code error;
+
+    const asio::ip::address_v4 address = asio::ip::make_address_v4(t_address.ip, error);
+    if (error)
+    {
+        logError("Invalid udp destination {}: {}", t_address, error.message());
+        return false;
+    }
+
+    t_destination->endpoint = asio::ip::udp::endpoint{address, t_address.port};
+    return true;
+}
+
 bool UdpServer::send(const google::protobuf::MessageLite &t_message, const NetworkAddress &t_address)
 {
-    if (!t_message.SerializeToArray(m_buffer.data(), m_buffer.size()))
+    const Destination *const destination = cachedDestination(t_address);
+    return destination != nullptr && send(t_message, *destination);
+}
+
+bool UdpServer::send(const google::protobuf::MessageLite &t_message, const Destination &t_destination)
+{
+    const size_t size = t_message.ByteSizeLong();
+    if (size <= m_buffer.size())
+    {
+        t_message.SerializeWithCachedSizesToArray(reinterpret_cast<uint8_t *>(m_buffer.data()));
+        return send(size, t_destination);
+    }
+
+    // too large for the internal buffer, but it may still fit a datagram
+    std::span<const char> data;
+    if (!serialize(t_message, pendingSize(), &data))
+        return false;
+
+    return sendTo(asio::buffer(data.data(), data.size()), t_destination.endpoint);
+}
+
+bool UdpServer::send(const std::span<const char> t_header, const google::protobuf::MessageLite &t_message,
+                     const NetworkAddress &t_address)
+{
+    const Destination *const destination = cachedDestination(t_address);
+    return destination != nullptr && send(t_header, t_message, *destination);
+}
+
+bool UdpServer::send(const std::span<const char> t_header, const google::protobuf::MessageLite &t_message,
+                     const Destination &t_destination)
+{
+    // placed after the pending batch so it stays intact
+    std::span<const char> payload;
+    if (!serialize(t_message, pendingSize(), &payload))
+        return false;
+
+    if (t_header.size() + payload.size() > kMaxDatagramSize)
     {
-        logError("Failed to serializeToArray (Maybe need to adjust Setting::kMaxUdpPacketSize)");
+        logError("Udp datagram of {} bytes is too large", t_header.size() + payload.size());
         return false;
     }
 
-    const size_t serialized_size = t_message.ByteSizeLong();
+    // gathered by the kernel (sendmsg), so the header and payload are never copied together
+    const std::array<asio::const_buffer, 2> buffers = {
+        asio::buffer(t_header.data(), t_header.size()),
+        asio::buffer(payload.data(), payload.size()),
+    };
 
-    return send(serialized_size, t_address);
+    return sendTo(buffers, t_destination.endpoint);
 }
 
 bool UdpServer::send(const size_t t_size, const NetworkAddress &t_address)
 {
-    const asio::ip::address_v4    address = asio::ip::make_address_v4(t_address.ip);
-    const asio::ip::udp::endpoint endpoint{address, t_address.port};
+    const Destination *const destination = cachedDestination(t_address);
+    return destination != nullptr && send(t_size, *destination);
+}
+
+bool UdpServer::send(const size_t t_size, const Destination &t_destination)
+{
+    return sendTo(asio::buffer(m_buffer, t_size), t_destination.endpoint);
+}
+
+bool UdpServer::enqueue(const google::protobuf::MessageLite &t_message, const NetworkAddress &t_address)
+{
+    const Destination *const destination = cachedDestination(t_address);
+    return destination != nullptr && enqueue(t_message, *destination);
+}
+
+bool UdpServer::enqueue(const google::protobuf::MessageLite &t_message, const Destination &t_destination)
+{
+    const size_t offset = pendingSize();
+
+    std::span<const char> data;
+    if (!serialize(t_message, offset, &data))
+        return false;
 
+    m_pending.push_back({
+        .offset   = offset,
+        .size     = data.size(),
+        .endpoint = t_destination.endpoint,
+    });
+
+    return true;
+}
+
+bool UdpServer::flush()
+{
+    if (m_pending.empty())
+        return true;
+
+    bool result = true;
+
+#if defined(__linux__)
+    m_batch_headers.resize(m_pending.size());
+    m_batch_vectors.resize(m_pending.size());
+
+    // the arena doesn't move anymore, so the pointers can be taken now
+    for (size_t i = 0; i < m_pending.size(); ++i)
+    {
+        Pending &pending = m_pending[i];
+
+        m_batch_vectors[i].iov_base = m_arena.data() + pending.offset;
+        m_batch_vectors[i].iov_len  = pending.size;
+
+        msghdr &header     = m_batch_headers[i].msg_hdr;
+        header             = {};
+        header.msg_name    = pending.endpoint.data();
+        header.msg_namelen = static_cast<socklen_t>(pending.endpoint.size());
+        header.msg_iov     = &m_batch_vectors[i];
+        header.msg_iovlen  = 1;
+    }
+
+    size_t sent = 0;
+    while (sent < m_batch_headers.size())
+    {
+        const int count =
+            sendmmsg(m_socket->native_handle(), m_batch_headers.data() + sent, m_batch_headers.size() - sent, 0);
+
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            logError("Udp batch send failed with [{}]: {}, {} messages dropped", errno, std::strerror(errno),
+                     m_batch_headers.size() - sent);
+            result = false;
+            break;
+        }
+
+        sent += count;
+    }
+#else
+    for (const Pending &pending : m_pending)
+        result = sendTo(asio::buffer(m_arena.data() + pending.offset, pending.size), pending.endpoint) && result;
+#endif
+
+    m_pending.clear();
+
+    return result;
+}
+
+bool UdpServer::serialize(const google::protobuf::MessageLite &t_message, const size_t t_offset,
+                          std::span<const char> *const t_data)
+{
+    const size_t size = t_message.ByteSizeLong();
+    if (size > kMaxDatagramSize)
+    {
+        logError("Message of {} bytes doesn't fit in a udp datagram", size);
+        return false;
+    }
+
+    if (m_arena.size() < t_offset + size)
+        m_arena.resize(t_offset + size);
+
+    char *const data = m_arena.data() + t_offset;
+    t_message.SerializeWithCachedSizesToArray(reinterpret_cast<uint8_t *>(data));
+
+    *t_data = std::span<const char>(data, size);
+    return true;
+}
+
+const UdpServer::Destination *UdpServer::cachedDestination(const NetworkAddress &t_address)
+{
+    for (const CachedDestination &cached : m_destinations)
+    {
+        if (cached.port == t_address.port && cached.ip == t_address.ip)
+            return &cached.destination;
+    }
+
+    Destination destination;
+    if (!resolve(t_address, &destination))
+        return nullptr;
+
+    // senders only talk to a handful of addresses, so the oldest one is simply replaced when full
+    if (m_destinations.size() == kMaxCachedDestinations)
+        m_destinations.erase(m_destinations.begin());
+
+    return &m_destinations
+                .emplace_back(CachedDestination{
+                    .ip          = t_address.ip,
+                    .port        = t_address.port,
+                    .destination = destination,
+                })
+                .destination;
+}
+
+template <typename Buffers>
+bool UdpServer::sendTo(const Buffers &t_buffers, const asio::ip::udp::endpoint &t_endpoint)
+{
     asio::error_code error;
 
-    m_socket->send_to(asio::buffer(m_buffer, t_size), endpoint, 0, error);
+    m_socket->send_to(t_buffers, t_endpoint, 0, error);
 
     if (error)
     {
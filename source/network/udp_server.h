@@ -7,13 +7,42 @@ namespace Immortals::Common
 class UdpServer
 {
 public:
+    // Largest payload of an ipv4 udp datagram
+    static constexpr size_t kMaxDatagramSize = 65'507;
+
+    // A destination that is resolved once, so sending to it does no parsing or allocation
+    struct Destination
+    {
+        asio::ip::udp::endpoint endpoint;
+    };
+
     UdpServer();
 
-    // Serializes the protobuf message to the internal buffer and sends it
+    static bool resolve(const NetworkAddress &t_address, Destination *t_destination);
+
+    // The NetworkAddress overloads look the destination up in a small cache of resolved addresses
+
+    // Serializes the protobuf message to the internal buffer and sends it,
+    // messages larger than the buffer go through the arena instead
     bool send(const google::protobuf::MessageLite &t_message, const NetworkAddress &t_address);
+    bool send(const google::protobuf::MessageLite &t_message, const Destination &t_destination);
+
+    // Sends t_header followed by the message in one datagram, without copying the header
+    bool send(std::span<const char> t_header, const google::protobuf::MessageLite &t_message,
+              const NetworkAddress &t_address);
+    bool send(std::span<const char> t_header, const google::protobuf::MessageLite &t_message,
+              const Destination &t_destination);
+
+    // Serializes the message into the pending batch, which is sent by flush
+    bool enqueue(const google::protobuf::MessageLite &t_message, const NetworkAddress &t_address);
+    bool enqueue(const google::protobuf::MessageLite &t_message, const Destination &t_destination);
+
+    // Sends all enqueued messages, with a single sendmmsg call on linux
+    bool flush();
 
     // Sends the first t_size bytes of the internal bugffer
     bool send(size_t t_size, const NetworkAddress &t_address);
+    bool send(size_t t_size, const Destination &t_destination);
 
     std::span<char> getBuffer()
     {
@@ -26,11 +55,54 @@ public:
     }
 
 private:
+    // Serializes t_message into m_arena after t_offset, computing its size only once
+    bool serialize(const google::protobuf::MessageLite &t_message, size_t t_offset, std::span<const char> *t_data);
+
+    [[nodiscard]] size_t pendingSize() const
+    {
+        return m_pending.empty() ? 0 : m_pending.back().offset + m_pending.back().size;
+    }
+
+    const Destination *cachedDestination(const NetworkAddress &t_address);
+
+    template <typename Buffers>
+    bool sendTo(const Buffers &t_buffers, const asio::ip::udp::endpoint &t_endpoint);
+
     asio::ip::udp::endpoint m_listen_endpoint;
 
     std::unique_ptr<asio::io_context>      m_context;
     std::unique_ptr<asio::ip::udp::socket> m_socket;
 
     std::array<char, Config::Network::kMaxUdpPacketSize> m_buffer = {};
+
+    // reused for every serialization, it only grows
+    std::vector<char> m_arena;
+
+    struct Pending
+    {
+        size_t offset = 0;
+        size_t size   = 0;
+
+        asio::ip::udp::endpoint endpoint;
+    };
+
+    std::vector<Pending> m_pending;
+
+    static constexpr size_t kMaxCachedDestinations = 8;
+
+    struct CachedDestination
+    {
+        std::string    ip;
+        unsigned short port = 0;
+
+        Destination destination;
+    };
+
+    std::vector<CachedDestination> m_destinations;
+
+#if defined(__linux__)
+    std::vector<mmsghdr> m_batch_headers;
+    std::vector<iovec>   m_batch_vectors;
+#endif
 };
 } // namespace Immortals::Common
@@ -2,10 +2,14 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <deque>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -17,6 +21,7 @@
 #include <span>
 #include <string.h>
 #include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <variant>
 #include <vector>
@@ -50,6 +55,14 @@
 #include <nng/protocol/pubsub0/pub.h>
 #include <nng/protocol/pubsub0/sub.h>
 
+#if defined(__linux__) || defined(__APPLE__)
+// shared memory transport
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include <google/protobuf/message_lite.h>
 #endif
 
@@ -57,6 +70,11 @@
 #include <lmdb.h>
 #endif
 
+#if FEATURE_ZSTD
+#include <zdict.h>
+#include <zstd.h>
+#endif
+
 #if FEATURE_RAYLIB
 #include <raylib.h>
 
@@ -104,6 +122,8 @@
 
 #include "services.h"
 
+#include "container/spsc_queue.h"
+
 #include "math/angle.h"
 #include "math/geom/circle.h"
 #include "math/geom/line.h"
@@ -134,6 +154,7 @@
 #if FEATURE_DEBUG
 #include "debugging/color.h"
 #include "debugging/draw.h"
+#include "debugging/draw_batch.h"
 #include "debugging/execution_time.h"
 #include "debugging/hub.h"
 
@@ -142,6 +163,7 @@
 #endif
 
 #include "debugging/source_location.h"
+#include "debugging/string_table.h"
 #include "debugging/wrapper.h"
 #endif
 
@@ -155,11 +177,13 @@
 
 #include "network/address.h"
 #if FEATURE_UDP
+#include "network/udp_context.h"
 #include "network/udp_client.h"
 #include "network/udp_server.h"
 #endif
 
 #if FEATURE_NNG
+#include "network/shm_ring.h"
 #include "network/nng_client.h"
 #include "network/nng_message.h"
 #include "network/nng_server.h"
@@ -194,4 +218,7 @@
 #include "storage/dumper.h"
 #endif
 #include "storage/storage.h"
+#if FEATURE_ZSTD
+#include "storage/zstd_codec.h"
+#endif
 #endif
@@ -20,7 +20,7 @@ bool Services::initialize([[maybe_unused]] const Params &t_params)
 #endif
 
 #if FEATURE_STORAGE
-    if (!Storage::init(t_params.t_db_path))
+    if (!Storage::init(t_params.t_db_path, t_params.t_db_options))
     {
         return false;
     }
@@ -40,6 +40,12 @@ bool Services::initialize([[maybe_unused]] const Params &t_params)
 
 void Services::shutdown()
 {
+#if FEATURE_DEBUG
+    // the serializer thread still logs and reads the config while it sends the last frame
+    if (s_debug != nullptr)
+        s_debug->stopSerializer();
+#endif
+
     delete s_field_state;
 #if FEATURE_STORAGE
     Storage::shutdown();
@@ -1,5 +1,9 @@
 #pragma once
 
+#if FEATURE_STORAGE
+#include "storage/storage.h"
+#endif
+
 namespace Immortals::Common
 {
 #if FEATURE_DEBUG
@@ -31,6 +35,7 @@ struct Services
 #endif
 #if FEATURE_STORAGE
         std::filesystem::path t_db_path;
+        StorageOptions        t_db_options;
 #endif
     };
 
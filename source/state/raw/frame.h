@@ -11,9 +11,13 @@ struct RawFrame
     TimePoint t_sent;
     TimePoint t_capture_camera;
 
+    // When the packet reached this host, as stamped by the kernel.
+    // Only known on the receiving side, it's not part of the proto.
+    TimePoint t_arrival;
+
     RawFrame() = default;
 
-    explicit RawFrame(const Protos::Ssl::Vision::DetectionFrame &t_frame)
+    explicit RawFrame(const Protos::Ssl::Vision::DetectionFrame &t_frame, const TimePoint t_arrival_time = {})
     {
         camera_id    = t_frame.camera_id();
         frame_number = t_frame.frame_number();
@@ -21,6 +25,8 @@ struct RawFrame
         t_capture        = TimePoint::fromSeconds(t_frame.t_capture());
         t_sent           = TimePoint::fromSeconds(t_frame.t_sent());
         t_capture_camera = TimePoint::fromSeconds(t_frame.t_capture_camera());
+
+        t_arrival = t_arrival_time;
     }
 
     explicit RawFrame(const Protos::Immortals::RawFrame &t_frame)
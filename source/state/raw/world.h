@@ -69,10 +69,11 @@ struct RawWorldState
         }
     }
 
-    void addFrame(const Protos::Ssl::Vision::DetectionFrame &t_frame)
+    // t_arrival is the receive time of the packet, see UdpClient::receive
+    void addFrame(const Protos::Ssl::Vision::DetectionFrame &t_frame, const TimePoint t_arrival = {})
     {
         const unsigned frame_idx = frames.size();
-        frames.emplace_back(t_frame);
+        frames.emplace_back(t_frame, t_arrival);
 
         for (const auto &ball : t_frame.balls())
         {
@@ -2,20 +2,123 @@
 
 namespace Immortals::Common
 {
+Dumper::Dumper(const Duration t_durability, const size_t t_queue_size)
+    : m_queue(t_queue_size), m_durability(t_durability)
+{
+    m_writer = std::thread(&Dumper::write, this);
+}
+
+Dumper::~Dumper()
+{
+    m_running.store(false, std::memory_order_release);
+    m_writer.join();
+
+    const Stats stats = this->stats();
+    if (stats.dropped > 0 || stats.failed > 0)
+        logWarning("Dumper dropped {} and failed to write {} of {} received messages", stats.dropped, stats.failed,
+                   stats.received);
+    if (stats.out_of_order > 0)
+        logWarning("Dumper received {} messages with out of order timestamps", stats.out_of_order);
+}
+
 bool Dumper::process()
 {
     bool any = false;
 
     for (Entry &entry : m_entries)
     {
-        const NngMessage message = entry.client.receiveRaw();
-        if (message.size() == 0)
-            continue;
+        while (true)
+        {
+            NngMessage message = entry.client.receiveRaw();
+            if (message.size() == 0)
+                break;
 
-        any = true;
-        entry.storage.storeRaw(message.time().microseconds(), {message.data(), message.size()});
+            any = true;
+            m_received.fetch_add(1, std::memory_order_relaxed);
+
+            if (!m_queue.push({&entry.storage, std::move(message)}))
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
     }
 
     return any;
 }
+
+Dumper::Stats Dumper::stats() const
+{
+    size_t out_of_order = 0;
+    for (const Entry &entry : m_entries)
+        out_of_order += entry.storage.writeStats().out_of_order;
+
+    return {
+        .queue_depth        = m_queue.size(),
+        .queue_capacity     = m_queue.capacity(),
+        .received           = m_received.load(std::memory_order_relaxed),
+        .written            = m_written.load(std::memory_order_relaxed),
+        .dropped            = m_dropped.load(std::memory_order_relaxed),
+        .failed             = m_failed.load(std::memory_order_relaxed),
+        .out_of_order       = out_of_order,
+        .last_write_latency = Duration::fromMicroseconds(m_last_write_latency.load(std::memory_order_relaxed)),
+        .max_write_latency  = Duration::fromMicroseconds(m_max_write_latency.load(std::memory_order_relaxed)),
+    };
+}
+
+void Dumper::write()
+{
+    Debug::setThreadName("Dumper");
+
+    // lmdb write transactions belong to the thread that began them, so the batch lives here
+    Storage::Batch batch{m_durability};
+
+    Item item;
+
+    while (true)
+    {
+        // sampled before draining, so nothing queued before shutdown is left behind
+        const bool running = m_running.load(std::memory_order_acquire);
+
+        while (m_queue.pop(&item))
+        {
+            const TimePoint start = TimePoint::now();
+
+            const NngMessage &message = item.message;
+            if (item.storage->storeRaw(message.time().microseconds(), {message.data(), message.size()}, &batch))
+                m_written.fetch_add(1, std::memory_order_relaxed);
+            else
+                m_failed.fetch_add(1, std::memory_order_relaxed);
+
+            countDiscarded(&batch);
+
+            const uint64_t latency = (TimePoint::now() - start).microseconds();
+            m_last_write_latency.store(latency, std::memory_order_relaxed);
+            if (latency > m_max_write_latency.load(std::memory_order_relaxed))
+                m_max_write_latency.store(latency, std::memory_order_relaxed);
+
+            // give the buffer back to nng right away instead of keeping it in the slot
+            item.message = {};
+        }
+
+        batch.flush();
+        countDiscarded(&batch);
+
+        if (!running)
+            break;
+
+        std::this_thread::sleep_for(kIdleSleep);
+    }
+
+    batch.commit();
+    countDiscarded(&batch);
+}
+
+void Dumper::countDiscarded(Storage::Batch *const t_batch)
+{
+    // these were counted as written when the batch took them
+    const size_t discarded = t_batch->takeDiscarded();
+    if (discarded == 0)
+        return;
+
+    m_written.fetch_sub(discarded, std::memory_order_relaxed);
+    m_failed.fetch_add(discarded, std::memory_order_relaxed);
+}
 } // namespace Immortals::Common
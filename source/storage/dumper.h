@@ -1,35 +1,93 @@
-
 #pragma once
 
+#include "../container/spsc_queue.h"
 #include "../network/nng_client.h"
 #include "storage.h"
 
 namespace Immortals::Common
 {
+// Receives messages on the caller's thread and hands them to a dedicated writer thread,
+// so a slow disk delays the recording instead of dropping messages at the sockets.
 class Dumper
 {
 public:
-    Dumper() = default;
+    struct Stats
+    {
+        size_t queue_depth    = 0;
+        size_t queue_capacity = 0;
+
+        size_t received = 0;
+        size_t written  = 0;
+        size_t dropped  = 0; // the queue was full
+        size_t failed   = 0; // the storage rejected the write, or lost it with a failed batch
+
+        size_t out_of_order = 0; // keys that arrived before the last stored one
+
+        Duration last_write_latency;
+        Duration max_write_latency;
+    };
+
+    // Received messages of all entries are committed together once per durability window
+    explicit Dumper(Duration t_durability = Duration::fromMilliseconds(100), size_t t_queue_size = 1024);
+    ~Dumper();
+
+    Dumper(const Dumper &)            = delete;
+    Dumper &operator=(const Dumper &) = delete;
 
-    void addEntry(std::string_view t_url, std::string_view t_db)
+    // With a topic, only that stream of the socket is recorded
+    void addEntry(std::string_view t_url, std::string_view t_db, std::string_view t_topic = {})
     {
-        m_entries.emplace_back(t_url, t_db);
+        m_entries.emplace_back(t_url, t_db, t_topic);
     }
 
+    // Receives everything pending on all entries and queues it for the writer
     bool process();
 
+    // Should be called from the thread that adds the entries
+    [[nodiscard]] Stats stats() const;
+
 private:
+    void write();
+
+    // Moves the writes the batch lost after accepting them from written to failed
+    void countDiscarded(Storage::Batch *t_batch);
+
     struct Entry
     {
         NngClient client;
         Storage   storage;
 
-        Entry(const std::string_view t_url, const std::string_view t_db) : client(t_url)
+        Entry(const std::string_view t_url, const std::string_view t_db, const std::string_view t_topic)
+            : client(t_topic.empty() ? NngClient{t_url} : NngClient{t_url, {t_topic}})
         {
             storage.open(t_db);
         }
     };
 
-    std::vector<Entry> m_entries;
+    struct Item
+    {
+        Storage   *storage = nullptr;
+        NngMessage message;
+    };
+
+    static constexpr std::chrono::milliseconds kIdleSleep{1};
+
+    // deque keeps the storages in place while the writer refers to them
+    std::deque<Entry> m_entries;
+
+    SpscQueue<Item> m_queue;
+
+    Duration m_durability;
+
+    std::atomic<bool> m_running = true;
+    std::thread       m_writer;
+
+    std::atomic<size_t> m_received = 0;
+    std::atomic<size_t> m_written  = 0;
+    std::atomic<size_t> m_dropped  = 0;
+    std::atomic<size_t> m_failed   = 0;
+
+    std::atomic<uint64_t> m_last_write_latency = 0;
+    std::atomic<uint64_t> m_max_write_latency  = 0;
 };
 } // namespace Immortals::Common
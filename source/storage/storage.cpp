@@ -70,7 +70,38 @@ static std::string getErrorString(const int t_error)
     }
 }
 
-bool Storage::init(const std::filesystem::path &t_path)
+// Read transactions are reset instead of aborted and kept by the thread that finished them,
+// so the next lookup only renews one and skips taking a slot from the shared reader table.
+struct ReadCache
+{
+    std::vector<MDB_txn *> transactions;
+
+    ReadCache();
+    ~ReadCache();
+};
+
+static std::mutex               s_read_caches_mutex;
+static std::vector<ReadCache *> s_read_caches;
+
+static thread_local ReadCache s_read_cache;
+
+ReadCache::ReadCache()
+{
+    const std::lock_guard lock{s_read_caches_mutex};
+    s_read_caches.push_back(this);
+}
+
+ReadCache::~ReadCache()
+{
+    const std::lock_guard lock{s_read_caches_mutex};
+
+    for (MDB_txn *const transaction : transactions)
+        mdb_txn_abort(transaction);
+
+    std::erase(s_read_caches, this);
+}
+
+bool Storage::init(const std::filesystem::path &t_path, const Options &t_options)
 {
     // create output directory if not exists
     if (!std::filesystem::exists(t_path))
@@ -83,6 +114,8 @@ bool Storage::init(const std::filesystem::path &t_path)
         }
     }
 
+    s_options = t_options;
+
     int result;
 
     result = mdb_env_create(&s_env);
@@ -99,27 +132,77 @@ bool Storage::init(const std::filesystem::path &t_path)
         return false;
     }
 
-    result = mdb_env_set_mapsize(s_env, kMapSize);
+    result = mdb_env_set_mapsize(s_env, s_options.map_size);
     if (result != MDB_SUCCESS)
     {
         logCritical("lmdb env map size setter failed with: {}", getErrorString(result));
         return false;
     }
 
-    result = mdb_env_open(s_env, t_path.string().c_str(), 0, 0664);
+    // views can hold read transactions for a while and be passed between threads,
+    // so they must not be tied to the thread-local reader slot
+    unsigned flags = MDB_NOTLS;
+    if (s_options.no_sync)
+        flags |= MDB_NOSYNC;
+    if (s_options.no_meta_sync)
+        flags |= MDB_NOMETASYNC;
+    if (s_options.write_map)
+        flags |= MDB_WRITEMAP;
+    if (s_options.no_read_ahead)
+        flags |= MDB_NORDAHEAD;
+
+    result = mdb_env_open(s_env, t_path.string().c_str(), flags, 0664);
     if (result != MDB_SUCCESS)
     {
         logCritical("lmdb env open in \"{}\" failed with: {}", t_path.string(), getErrorString(result));
         return false;
     }
 
-    logInfo("Initialized storage in \"{}\"", t_path.string());
+    const Options effective = options();
+
+    logInfo("Initialized storage in \"{}\" with map size {} MB (growth {} MB), no_sync: {}, no_meta_sync: {}, "
+            "write_map: {}, no_read_ahead: {}",
+            t_path.string(), effective.map_size / (1024 * 1024), effective.map_growth / (1024 * 1024),
+            effective.no_sync, effective.no_meta_sync, effective.write_map, effective.no_read_ahead);
 
     return true;
 }
 
+Storage::Options Storage::options()
+{
+    Options options = s_options;
+
+    // an existing db can be larger than what was asked for
+    MDB_envinfo info;
+    if (s_env != nullptr && mdb_env_info(s_env, &info) == MDB_SUCCESS)
+        options.map_size = info.me_mapsize;
+
+    unsigned flags;
+    if (s_env != nullptr && mdb_env_get_flags(s_env, &flags) == MDB_SUCCESS)
+    {
+        options.no_sync       = flags & MDB_NOSYNC;
+        options.no_meta_sync  = flags & MDB_NOMETASYNC;
+        options.write_map     = flags & MDB_WRITEMAP;
+        options.no_read_ahead = flags & MDB_NORDAHEAD;
+    }
+
+    return options;
+}
+
 void Storage::shutdown()
 {
+    {
+        const std::lock_guard lock{s_read_caches_mutex};
+
+        for (ReadCache *const cache : s_read_caches)
+        {
+            for (MDB_txn *const transaction : cache->transactions)
+                mdb_txn_abort(transaction);
+
+            cache->transactions.clear();
+        }
+    }
+
     mdb_env_close(s_env);
     s_env = nullptr;
 }
@@ -128,13 +211,15 @@ bool Storage::open(std::string_view t_name)
 {
     int result;
 
+    enterTransaction();
+
     MDB_txn *transaction;
     result = mdb_txn_begin(s_env, nullptr, 0, &transaction);
     if (result != MDB_SUCCESS)
     {
         logCritical("lmdb transaction begin failed with: {}", getErrorString(result));
 
-        mdb_txn_abort(transaction);
+        leaveTransaction();
         return false;
     }
 
@@ -146,17 +231,47 @@ bool Storage::open(std::string_view t_name)
     {
         logCritical("lmdb db \"{}\" open failed with: {}", t_name, getErrorString(result));
 
-        mdb_txn_abort(transaction);
+        abortWrite(transaction, nullptr);
+        return false;
+    }
+
+#if FEATURE_ZSTD
+    result = mdb_dbi_open(transaction, kDictionariesDb.data(), MDB_INTEGERKEY | MDB_CREATE, &s_dictionaries_dbi);
+    if (result != MDB_SUCCESS)
+    {
+        logCritical("lmdb db \"{}\" open failed with: {}", kDictionariesDb, getErrorString(result));
+
+        abortWrite(transaction, nullptr);
+        return false;
+    }
+#endif
+
+    const std::string index_name = name_str + "_index";
+
+    result = mdb_dbi_open(transaction, index_name.c_str(), MDB_INTEGERKEY | MDB_CREATE, &m_index_dbi);
+    if (result != MDB_SUCCESS)
+    {
+        logCritical("lmdb db \"{}\" open failed with: {}", index_name, getErrorString(result));
+
+        abortWrite(transaction, nullptr);
         return false;
     }
 
+    loadLastKey(transaction);
+
+    m_index_complete = checkIndex(transaction);
+    if (!m_index_complete)
+        logWarning("The time index of \"{}\" doesn't cover all records, seeks won't use it until it's rebuilt",
+                   t_name);
+
     // this is needed to keep db handles
     result = mdb_txn_commit(transaction);
+
+    leaveTransaction();
+
     if (result != MDB_SUCCESS)
     {
         logCritical("lmdb transaction commit failed with: {}", getErrorString(result));
-
-        mdb_txn_abort(transaction);
         return false;
     }
 
@@ -170,15 +285,20 @@ bool Storage::close()
 
 bool Storage::get(Key t_key, google::protobuf::MessageLite *t_message) const
 {
-    int result;
+    View view;
+    if (!getRaw(t_key, &view))
+        return false;
 
-    MDB_txn *transaction;
-    result = mdb_txn_begin(s_env, nullptr, MDB_RDONLY, &transaction);
-    if (result != MDB_SUCCESS)
-    {
-        logError("lmdb readonly transaction begin failed with: {}", getErrorString(result));
+    return view.parse(t_message);
+}
+
+bool Storage::getRaw(Key t_key, View *const t_view) const
+{
+    t_view->reset();
+
+    MDB_txn *transaction = beginRead();
+    if (transaction == nullptr)
         return false;
-    }
 
     MDB_val mdb_key{
         .mv_size = sizeof(Key),
@@ -186,40 +306,24 @@ bool Storage::get(Key t_key, google::protobuf::MessageLite *t_message) const
     };
     MDB_val mdb_data;
 
-    MDB_cursor *mdb_cursor;
-
-    result = mdb_cursor_open(transaction, m_dbi, &mdb_cursor);
+    const int result = seek(transaction, &mdb_key, &mdb_data, MDB_SET_RANGE);
     if (result != MDB_SUCCESS)
     {
-        Common::logError("lmdb cursor open failed with: {}", getErrorString(result));
-
-        mdb_txn_abort(transaction);
-        return false;
-    }
-
-    result = mdb_cursor_get(mdb_cursor, &mdb_key, &mdb_data, MDB_SET_RANGE);
-    if (result == MDB_NOTFOUND)
-    {
-        Common::logWarning("lmdb cursor get failed with: {}", getErrorString(result));
-
-        mdb_txn_abort(transaction);
-        return false;
-    }
-    else if (result != MDB_SUCCESS)
-    {
-        Common::logError("lmdb get failed with: {}", getErrorString(result));
+        if (result == MDB_NOTFOUND)
+            logWarning("lmdb cursor get failed with: {}", getErrorString(result));
 
-        mdb_txn_abort(transaction);
+        endRead(transaction);
         return false;
     }
 
-    bool pb_result = t_message->ParseFromArray(mdb_data.mv_data, mdb_data.mv_size);
-
-    mdb_txn_abort(transaction);
+    // the data stays valid without the cursor, as long as the transaction is alive
+    t_view->m_transaction = transaction;
+    t_view->m_key         = *static_cast<Key *>(mdb_key.mv_data);
+    t_view->m_data        = {static_cast<const char *>(mdb_data.mv_data), mdb_data.mv_size};
 
-    if (!pb_result)
+    if (!decode(transaction, &t_view->m_data, &t_view->m_buffer))
     {
-        logError("Failed to parse protobuf message with size {} from db", mdb_data.mv_size);
+        t_view->reset();
         return false;
     }
 
@@ -228,15 +332,9 @@ bool Storage::get(Key t_key, google::protobuf::MessageLite *t_message) const
 
 bool Storage::closest(Key t_key, Key *t_closest) const
 {
-    int result;
-
-    MDB_txn *transaction;
-    result = mdb_txn_begin(s_env, nullptr, MDB_RDONLY, &transaction);
-    if (result != MDB_SUCCESS)
-    {
-        Common::logError("lmdb readonly transaction begin failed with: {}", getErrorString(result));
+    MDB_txn *transaction = beginRead();
+    if (transaction == nullptr)
         return false;
-    }
 
     MDB_val mdb_key{
         .mv_size = sizeof(Key),
@@ -244,61 +342,22 @@ bool Storage::closest(Key t_key, Key *t_closest) const
     };
     MDB_val mdb_data;
 
-    MDB_cursor *mdb_cursor;
-
-    result = mdb_cursor_open(transaction, m_dbi, &mdb_cursor);
-    if (result != MDB_SUCCESS)
-    {
-        Common::logError("lmdb cursor open failed with: {}", getErrorString(result));
-
-        mdb_txn_abort(transaction);
-        return false;
-    }
-
-    result = mdb_cursor_get(mdb_cursor, &mdb_key, &mdb_data, MDB_SET_RANGE);
+    const int result = seek(transaction, &mdb_key, &mdb_data, MDB_SET_RANGE);
     if (result == MDB_NOTFOUND)
-    {
-        Common::logWarning("lmdb cursor get failed with: {}", getErrorString(result));
-
-        mdb_txn_abort(transaction);
-        return false;
-    }
-    else if (result != MDB_SUCCESS)
-    {
-        Common::logError("lmdb cursor get failed with: {}", getErrorString(result));
+        logWarning("lmdb cursor get failed with: {}", getErrorString(result));
+    else if (result == MDB_SUCCESS)
+        *t_closest = *static_cast<Key *>(mdb_key.mv_data);
 
-        mdb_txn_abort(transaction);
-        return false;
-    }
-
-    *t_closest = *static_cast<Key *>(mdb_key.mv_data);
+    endRead(transaction);
 
-    mdb_txn_abort(transaction);
-
-    return true;
+    return result == MDB_SUCCESS;
 }
 
 bool Storage::next(Storage::Key t_key, Storage::Key *t_next) const
 {
-    int result;
-
-    MDB_txn *transaction;
-    result = mdb_txn_begin(s_env, nullptr, MDB_RDONLY, &transaction);
-    if (result != MDB_SUCCESS)
-    {
-        Common::logError("lmdb readonly transaction begin failed with: {}", getErrorString(result));
-        return false;
-    }
-
-    MDB_cursor *mdb_cursor;
-    result = mdb_cursor_open(transaction, m_dbi, &mdb_cursor);
-    if (result != MDB_SUCCESS)
-    {
-        Common::logError("lmdb cursor open failed with: {}", getErrorString(result));
-
-        mdb_txn_abort(transaction);
+    MDB_txn *transaction = beginRead();
+    if (transaction == nullptr)
         return false;
-    }
 
     MDB_val mdb_key{
         .mv_size = sizeof(Key),
@@ -306,224 +365,1108 @@ bool Storage::next(Storage::Key t_key, Storage::Key *t_next) const
     };
     MDB_val mdb_data;
 
-    result = mdb_cursor_get(mdb_cursor, &mdb_key, &mdb_data, MDB_SET_RANGE);
+    const int result = seek(transaction, &mdb_key, &mdb_data, MDB_SET_RANGE, MDB_NEXT);
     if (result == MDB_NOTFOUND)
-    {
-        Common::logWarning("lmdb cursor get failed with: {}", getErrorString(result));
+        logWarning("lmdb cursor get failed with: {}", getErrorString(result));
+    else if (result == MDB_SUCCESS)
+        *t_next = *static_cast<Key *>(mdb_key.mv_data);
 
-        mdb_txn_abort(transaction);
-        return false;
-    }
-    else if (result != MDB_SUCCESS)
-    {
-        Common::logError("lmdb cursor get failed with: {}", getErrorString(result));
+    endRead(transaction);
 
-        mdb_txn_abort(transaction);
-        return false;
-    }
+    return result == MDB_SUCCESS;
+}
 
-    result = mdb_cursor_get(mdb_cursor, &mdb_key, &mdb_data, MDB_NEXT);
-    if (result == MDB_NOTFOUND)
-    {
-        Common::logWarning("lmdb cursor get failed with: {}", getErrorString(result));
+bool Storage::range(Key t_from, const Key t_to, Range *const t_range) const
+{
+    t_range->reset();
 
-        mdb_txn_abort(transaction);
+    t_range->m_transaction = beginRead();
+    if (t_range->m_transaction == nullptr)
         return false;
-    }
-    else if (result != MDB_SUCCESS)
+
+    const int result = mdb_cursor_open(t_range->m_transaction, m_dbi, &t_range->m_cursor);
+    if (result != MDB_SUCCESS)
     {
-        Common::logError("lmdb cursor get failed with: {}", getErrorString(result));
+        logError("lmdb cursor open failed with: {}", getErrorString(result));
 
-        mdb_txn_abort(transaction);
+        t_range->m_cursor = nullptr;
+        t_range->reset();
         return false;
     }
 
-    *t_next = *static_cast<Key *>(mdb_key.mv_data);
+    t_range->m_storage = this;
+    t_range->m_to      = t_to;
 
-    mdb_txn_abort(transaction);
+    MDB_val mdb_key{
+        .mv_size = sizeof(Key),
+        .mv_data = &t_from,
+    };
+    MDB_val mdb_data;
 
-    return true;
+    return t_range->update(mdb_cursor_get(t_range->m_cursor, &mdb_key, &mdb_data, MDB_SET_RANGE), mdb_key, mdb_data);
 }
 
 unsigned long Storage::getBoundary(Key *t_first, Key *t_last) const
 {
-    int result;
-
-    MDB_txn *transaction;
-    result = mdb_txn_begin(s_env, nullptr, 0, &transaction);
-    if (result != MDB_SUCCESS)
-    {
-        Common::logError("lmdb read/write transaction begin failed with: {}", getErrorString(result));
+    MDB_txn *transaction = beginRead();
+    if (transaction == nullptr)
         return 0;
-    }
-
-    MDB_val     mdb_key, mdb_data;
-    MDB_cursor *mdb_cursor;
 
-    result = mdb_cursor_open(transaction, m_dbi, &mdb_cursor);
-    if (result != MDB_SUCCESS)
-    {
-        Common::logError("lmdb cursor open failed with: {}", getErrorString(result));
+    MDB_val mdb_key, mdb_data;
 
-        mdb_txn_abort(transaction);
-        return 0;
-    }
+    int result;
 
-    result = mdb_cursor_get(mdb_cursor, &mdb_key, &mdb_data, MDB_FIRST);
-    if (result == MDB_NOTFOUND)
-    {
-        mdb_txn_abort(transaction);
-        return 0;
-    }
-    else if (result != MDB_SUCCESS)
+    result = seek(transaction, &mdb_key, &mdb_data, MDB_FIRST);
+    if (result != MDB_SUCCESS)
     {
-        Common::logError("lmdb get failed with: {}", getErrorString(result));
-
-        mdb_txn_abort(transaction);
+        endRead(transaction);
         return 0;
     }
 
     *t_first = *static_cast<Key *>(mdb_key.mv_data);
 
-    result = mdb_cursor_get(mdb_cursor, &mdb_key, &mdb_data, MDB_LAST);
-    if (result == MDB_NOTFOUND)
+    result = seek(transaction, &mdb_key, &mdb_data, MDB_LAST);
+    if (result != MDB_SUCCESS)
     {
-        mdb_txn_abort(transaction);
+        endRead(transaction);
         return 0;
     }
-    else if (result != MDB_SUCCESS)
-    {
-        Common::logError("lmdb get failed with: {}", getErrorString(result));
 
-        mdb_txn_abort(transaction);
-        return 0;
-    }
     *t_last = *static_cast<Key *>(mdb_key.mv_data);
 
     MDB_stat stat;
     result = mdb_stat(transaction, m_dbi, &stat);
+
+    endRead(transaction);
+
     if (result != MDB_SUCCESS)
     {
-        mdb_txn_abort(transaction);
         Common::logError("Could not get stats: {}", getErrorString(result));
-
-        mdb_txn_abort(transaction);
         return 0;
     }
 
-    result = mdb_txn_commit(transaction);
-    if (result != MDB_SUCCESS)
+    return stat.ms_entries;
+}
+
+bool Storage::decode([[maybe_unused]] MDB_txn *const t_transaction, [[maybe_unused]] std::span<const char> *const t_data,
+                     [[maybe_unused]] std::vector<char> *const t_buffer) const
+{
+#if FEATURE_ZSTD
+    if (!ZstdCodec::isEncoded(*t_data))
+        return true;
+
+    const auto loader = [t_transaction](unsigned t_id, std::vector<char> *const t_dictionary)
     {
-        Common::logError("lmdb transaction commit failed with: {}", getErrorString(result));
+        MDB_val mdb_key{
+            .mv_size = sizeof(t_id),
+            .mv_data = &t_id,
+        };
+        MDB_val mdb_data;
+
+        const int result = mdb_get(t_transaction, s_dictionaries_dbi, &mdb_key, &mdb_data);
+        if (result != MDB_SUCCESS)
+        {
+            logError("lmdb get for zstd dictionary {} failed with: {}", t_id, getErrorString(result));
+            return false;
+        }
 
-        mdb_txn_abort(transaction);
+        const char *const data = static_cast<const char *>(mdb_data.mv_data);
+        t_dictionary->assign(data, data + mdb_data.mv_size);
+        return true;
+    };
+
+    if (!m_codec.decode(*t_data, t_buffer, loader))
         return false;
-    }
 
-    return stat.ms_entries;
+    *t_data = *t_buffer;
+#endif
+
+    return true;
 }
 
-bool Storage::store(Key t_key, const google::protobuf::MessageLite &t_message)
+#if FEATURE_ZSTD
+bool Storage::enableCompression(const int t_level, const std::span<const char> t_dictionary)
 {
-    int result;
+    if (!m_codec.enable(t_level, t_dictionary))
+        return false;
 
-    MDB_txn *transaction;
-    result = mdb_txn_begin(s_env, nullptr, 0, &transaction);
-    if (result != MDB_SUCCESS)
-    {
-        logError("lmdb read/write transaction begin failed with: {}", getErrorString(result));
+    const unsigned id = m_codec.dictionaryId();
+    if (t_dictionary.empty() || id == 0)
+        return true;
+
+    MDB_txn *transaction = beginWrite(nullptr);
+    if (transaction == nullptr)
         return false;
-    }
 
-    const size_t message_size = t_message.ByteSizeLong();
+    unsigned mdb_id = id;
 
     MDB_val mdb_key{
-        .mv_size = sizeof(Key),
-        .mv_data = &t_key,
+        .mv_size = sizeof(mdb_id),
+        .mv_data = &mdb_id,
     };
     MDB_val mdb_data{
-        .mv_size = message_size,
-        .mv_data = nullptr,
+        .mv_size = t_dictionary.size(),
+        .mv_data = const_cast<char *>(t_dictionary.data()),
     };
 
-    // dry put to ask lmdb to reserve the destination buffer
-    result = mdb_put(transaction, m_dbi, &mdb_key, &mdb_data, MDB_RESERVE);
-    if (result != MDB_SUCCESS)
+    // dictionaries are immutable once saved, as records refer to them by id
+    const int result = mdb_put(transaction, s_dictionaries_dbi, &mdb_key, &mdb_data, MDB_NOOVERWRITE);
+    if (result != MDB_SUCCESS && result != MDB_KEYEXIST)
     {
-        logError("lmdb dry put for key [{}] with size {} failed with: {}", t_key, message_size, getErrorString(result));
+        logError("lmdb put for zstd dictionary {} failed with: {}", id, getErrorString(result));
 
-        mdb_txn_abort(transaction);
+        abortWrite(transaction, nullptr);
+        m_codec.disable();
         return false;
     }
 
-    const bool pb_result = t_message.SerializeToArray(mdb_data.mv_data, mdb_data.mv_size);
-    if (!pb_result)
+    if (!endWrite(transaction, nullptr))
     {
-        logError("Failed to serialize protobuf message for db storage");
-
-        mdb_txn_abort(transaction);
+        m_codec.disable();
         return false;
     }
 
-    result = mdb_put(transaction, m_dbi, &mdb_key, &mdb_data, 0);
+    return true;
+}
+
+void Storage::disableCompression()
+{
+    m_codec.disable();
+}
+#endif
+
+int Storage::seek(MDB_txn *const t_transaction, MDB_val *const t_key, MDB_val *const t_data, const MDB_cursor_op t_op,
+                  const std::optional<MDB_cursor_op> t_then) const
+{
+    MDB_cursor *mdb_cursor;
+
+    int result = mdb_cursor_open(t_transaction, m_dbi, &mdb_cursor);
     if (result != MDB_SUCCESS)
     {
-        logError("lmdb put for key [{}] with size {} failed with: {}", t_key, mdb_data.mv_size, getErrorString(result));
+        logError("lmdb cursor open failed with: {}", getErrorString(result));
+        return result;
+    }
+
+    result = mdb_cursor_get(mdb_cursor, t_key, t_data, t_op);
+    if (result == MDB_SUCCESS && t_then.has_value())
+        result = mdb_cursor_get(mdb_cursor, t_key, t_data, t_then.value());
+
+    if (result != MDB_SUCCESS && result != MDB_NOTFOUND)
+        logError("lmdb cursor get failed with: {}", getErrorString(result));
+
+    // read-only cursors are not freed with their transaction
+    mdb_cursor_close(mdb_cursor);
+
+    return result;
+}
+
+MDB_txn *Storage::beginRead()
+{
+    enterTransaction();
+
+    std::vector<MDB_txn *> &cache = s_read_cache.transactions;
+
+    while (!cache.empty())
+    {
+        MDB_txn *const transaction = cache.back();
+        cache.pop_back();
+
+        const int result = mdb_txn_renew(transaction);
+        if (result == MDB_SUCCESS)
+            return transaction;
 
+        logWarning("lmdb readonly transaction renew failed with: {}", getErrorString(result));
         mdb_txn_abort(transaction);
-        return false;
     }
 
-    result = mdb_txn_commit(transaction);
+    MDB_txn  *transaction;
+    const int result = mdb_txn_begin(s_env, nullptr, MDB_RDONLY, &transaction);
     if (result != MDB_SUCCESS)
     {
-        logError("lmdb transaction commit failed with: {}", getErrorString(result));
+        logError("lmdb readonly transaction begin failed with: {}", getErrorString(result));
 
-        mdb_txn_abort(transaction);
-        return false;
+        leaveTransaction();
+        return nullptr;
     }
 
-    return true;
+    return transaction;
 }
-bool Storage::storeRaw(Key t_key, std::span<char> t_data)
+
+void Storage::endRead(MDB_txn *const t_transaction)
 {
-    int result;
+    if (t_transaction == nullptr)
+        return;
 
-    MDB_txn *transaction;
-    result = mdb_txn_begin(s_env, nullptr, 0, &transaction);
-    if (result != MDB_SUCCESS)
+    std::vector<MDB_txn *> &cache = s_read_cache.transactions;
+
+    // every cached transaction keeps its reader slot, so only a few are kept per thread
+    if (cache.size() < kMaxCachedReads)
     {
-        logError("lmdb read/write transaction begin failed with: {}", getErrorString(result));
-        return false;
+        mdb_txn_reset(t_transaction);
+        cache.push_back(t_transaction);
     }
-
+    else
+    {
+        mdb_txn_abort(t_transaction);
+    }
+
+    leaveTransaction();
+}
+
+void Storage::enterTransaction()
+{
+    // counted before checking the flag, so a resize either sees this transaction or it sees the resize
+    while (true)
+    {
+        s_active_transactions.fetch_add(1);
+        if (!s_resizing.load())
+            break;
+
+        s_active_transactions.fetch_sub(1);
+        while (s_resizing.load())
+            std::this_thread::yield();
+    }
+}
+
+void Storage::leaveTransaction()
+{
+    s_active_transactions.fetch_sub(1);
+}
+
+bool Storage::indexKeys(const Key t_from, const Key t_to, std::vector<Key> *const t_keys) const
+{
+    t_keys->clear();
+
+    MDB_txn *transaction = beginRead();
+    if (transaction == nullptr)
+        return false;
+
+    MDB_cursor *mdb_cursor;
+
+    int result = mdb_cursor_open(transaction, m_index_dbi, &mdb_cursor);
+    if (result != MDB_SUCCESS)
+    {
+        logError("lmdb cursor open failed with: {}", getErrorString(result));
+
+        endRead(transaction);
+        return false;
+    }
+
+    Key     bucket = t_from / kIndexBucket;
     MDB_val mdb_key{
         .mv_size = sizeof(Key),
-        .mv_data = &t_key,
+        .mv_data = &bucket,
     };
-    MDB_val mdb_data{
-        .mv_size = t_data.size(),
-        .mv_data = t_data.data(),
+    MDB_val mdb_data;
+
+    for (result = mdb_cursor_get(mdb_cursor, &mdb_key, &mdb_data, MDB_SET_RANGE); result == MDB_SUCCESS;
+         result = mdb_cursor_get(mdb_cursor, &mdb_key, &mdb_data, MDB_NEXT))
+    {
+        const Key key = *static_cast<const Key *>(mdb_data.mv_data);
+        if (key >= t_to)
+            break;
+
+        // the first bucket can start before t_from
+        if (key >= t_from)
+            t_keys->push_back(key);
+    }
+
+    if (result != MDB_SUCCESS && result != MDB_NOTFOUND)
+        logError("lmdb cursor get failed with: {}", getErrorString(result));
+
+    mdb_cursor_close(mdb_cursor);
+    endRead(transaction);
+
+    return result == MDB_SUCCESS || result == MDB_NOTFOUND;
+}
+
+bool Storage::sample(const Key t_from, const Key t_to, const Key t_step, std::vector<Key> *const t_keys) const
+{
+    t_keys->clear();
+
+    if (t_step == 0)
+        return false;
+
+    MDB_txn *transaction = beginRead();
+    if (transaction == nullptr)
+        return false;
+
+    MDB_cursor *mdb_cursor;
+
+    int result = mdb_cursor_open(transaction, m_dbi, &mdb_cursor);
+    if (result != MDB_SUCCESS)
+    {
+        logError("lmdb cursor open failed with: {}", getErrorString(result));
+
+        endRead(transaction);
+        return false;
+    }
+
+    MDB_cursor *index_cursor = nullptr;
+
+    if (m_index_complete)
+    {
+        result = mdb_cursor_open(transaction, m_index_dbi, &index_cursor);
+        if (result != MDB_SUCCESS)
+        {
+            logError("lmdb cursor open failed with: {}", getErrorString(result));
+
+            mdb_cursor_close(mdb_cursor);
+            endRead(transaction);
+            return false;
+        }
+    }
+
+    for (Key target = t_from; target < t_to; target += t_step)
+    {
+        // the previous result can already satisfy this target
+        if (!t_keys->empty() && t_keys->back() >= target)
+            continue;
+
+        Key key;
+
+        result = seekIndexed(index_cursor, mdb_cursor, target, &key);
+        if (result != MDB_SUCCESS)
+            break;
+
+        if (key >= t_to)
+            break;
+
+        t_keys->push_back(key);
+    }
+
+    if (result != MDB_SUCCESS && result != MDB_NOTFOUND)
+        logError("lmdb cursor get failed with: {}", getErrorString(result));
+
+    if (index_cursor != nullptr)
+        mdb_cursor_close(index_cursor);
+
+    mdb_cursor_close(mdb_cursor);
+    endRead(transaction);
+
+    return result == MDB_SUCCESS || result == MDB_NOTFOUND;
+}
+
+bool Storage::seekAll(const std::span<const Storage *const> t_storages, const Key t_key,
+                      const std::span<std::optional<Key>> t_keys)
+{
+    if (t_keys.size() < t_storages.size())
+    {
+        logError("seekAll needs {} keys but was given {}", t_storages.size(), t_keys.size());
+        return false;
+    }
+
+    MDB_txn *transaction = beginRead();
+    if (transaction == nullptr)
+        return false;
+
+    bool any = false;
+
+    for (size_t i = 0; i < t_storages.size(); ++i)
+    {
+        const Storage *const storage = t_storages[i];
+
+        t_keys[i].reset();
+
+        MDB_cursor *mdb_cursor;
+        MDB_cursor *index_cursor = nullptr;
+
+        int result = mdb_cursor_open(transaction, storage->m_dbi, &mdb_cursor);
+        if (result != MDB_SUCCESS)
+        {
+            logError("lmdb cursor open failed with: {}", getErrorString(result));
+            continue;
+        }
+
+        if (storage->m_index_complete)
+        {
+            result = mdb_cursor_open(transaction, storage->m_index_dbi, &index_cursor);
+            if (result != MDB_SUCCESS)
+            {
+                logError("lmdb cursor open failed with: {}", getErrorString(result));
+                index_cursor = nullptr;
+            }
+        }
+
+        Key key;
+
+        result = storage->seekIndexed(index_cursor, mdb_cursor, t_key, &key);
+        if (result == MDB_SUCCESS)
+        {
+            t_keys[i] = key;
+            any       = true;
+        }
+        else if (result != MDB_NOTFOUND)
+        {
+            logError("lmdb cursor get failed with: {}", getErrorString(result));
+        }
+
+        if (index_cursor != nullptr)
+            mdb_cursor_close(index_cursor);
+
+        mdb_cursor_close(mdb_cursor);
+    }
+
+    endRead(transaction);
+
+    return any;
+}
+
+int Storage::seekIndexed(MDB_cursor *const t_index_cursor, MDB_cursor *const t_cursor, const Key t_key,
+                         Key *const t_found) const
+{
+    if (t_index_cursor != nullptr)
+    {
+        Key     bucket = t_key / kIndexBucket;
+        MDB_val mdb_bucket{
+            .mv_size = sizeof(Key),
+            .mv_data = &bucket,
+        };
+        MDB_val mdb_first;
+
+        const int result = mdb_cursor_get(t_index_cursor, &mdb_bucket, &mdb_first, MDB_SET_RANGE);
+
+        // no bucket at or after t_key means no record either
+        if (result != MDB_SUCCESS)
+            return result;
+
+        // either t_key's bucket is empty and this is the first key of a later one,
+        // or t_key doesn't come after the first key of its bucket
+        const Key first = *static_cast<const Key *>(mdb_first.mv_data);
+        if (first >= t_key)
+        {
+            *t_found = first;
+            return MDB_SUCCESS;
+        }
+    }
+
+    Key     key = t_key;
+    MDB_val mdb_key{
+        .mv_size = sizeof(Key),
+        .mv_data = &key,
     };
+    MDB_val mdb_data;
+
+    const int result = mdb_cursor_get(t_cursor, &mdb_key, &mdb_data, MDB_SET_RANGE);
+    if (result == MDB_SUCCESS)
+        *t_found = *static_cast<const Key *>(mdb_key.mv_data);
+
+    return result;
+}
+
+bool Storage::checkIndex(MDB_txn *const t_transaction) const
+{
+    MDB_val mdb_key, mdb_data;
 
-    result = mdb_put(transaction, m_dbi, &mdb_key, &mdb_data, 0);
+    int result = seek(t_transaction, &mdb_key, &mdb_data, MDB_FIRST);
+    if (result == MDB_NOTFOUND)
+        return true;
+    if (result != MDB_SUCCESS)
+        return false;
+
+    const Key first_bucket = *static_cast<const Key *>(mdb_key.mv_data) / kIndexBucket;
+
+    MDB_cursor *mdb_cursor;
+
+    result = mdb_cursor_open(t_transaction, m_index_dbi, &mdb_cursor);
     if (result != MDB_SUCCESS)
     {
-        logError("lmdb put for key [{}] with size {} failed with: {}", t_key, mdb_data.mv_size, getErrorString(result));
+        logError("lmdb cursor open failed with: {}", getErrorString(result));
+        return false;
+    }
 
-        mdb_txn_abort(transaction);
+    result = mdb_cursor_get(mdb_cursor, &mdb_key, &mdb_data, MDB_FIRST);
+
+    const bool complete = result == MDB_SUCCESS && *static_cast<const Key *>(mdb_key.mv_data) == first_bucket;
+
+    mdb_cursor_close(mdb_cursor);
+
+    return complete;
+}
+
+bool Storage::rebuildIndex()
+{
+    MDB_txn *transaction = beginWrite(nullptr);
+    if (transaction == nullptr)
+        return false;
+
+    int result = mdb_drop(transaction, m_index_dbi, 0);
+    if (result != MDB_SUCCESS)
+    {
+        logError("lmdb drop of the index failed with: {}", getErrorString(result));
+
+        abortWrite(transaction, nullptr);
         return false;
     }
 
-    result = mdb_txn_commit(transaction);
+    m_indexed_bucket = std::numeric_limits<Key>::max();
+
+    MDB_cursor *mdb_cursor;
+
+    result = mdb_cursor_open(transaction, m_dbi, &mdb_cursor);
+    if (result != MDB_SUCCESS)
+    {
+        logError("lmdb cursor open failed with: {}", getErrorString(result));
+
+        abortWrite(transaction, nullptr);
+        return false;
+    }
+
+    MDB_val mdb_key, mdb_data;
+
+    size_t count = 0;
+    for (result = mdb_cursor_get(mdb_cursor, &mdb_key, &mdb_data, MDB_FIRST); result == MDB_SUCCESS;
+         result = mdb_cursor_get(mdb_cursor, &mdb_key, &mdb_data, MDB_NEXT))
+    {
+        result = updateIndex(transaction, *static_cast<const Key *>(mdb_key.mv_data));
+        if (result != MDB_SUCCESS)
+            break;
+
+        ++count;
+    }
+
+    mdb_cursor_close(mdb_cursor);
+
+    if (result != MDB_NOTFOUND)
+    {
+        logError("Rebuilding the index failed with: {}", getErrorString(result));
+
+        abortWrite(transaction, nullptr);
+        return false;
+    }
+
+    logInfo("Rebuilt the time index from {} records", count);
+
+    if (!endWrite(transaction, nullptr))
+        return false;
+
+    m_index_complete = true;
+    return true;
+}
+
+void Storage::loadLastKey(MDB_txn *const t_transaction)
+{
+    m_last_key_epoch = s_discard_epoch.load(std::memory_order_relaxed);
+
+    MDB_val mdb_key, mdb_data;
+
+    if (seek(t_transaction, &mdb_key, &mdb_data, MDB_LAST) == MDB_SUCCESS)
+        m_last_key = *static_cast<const Key *>(mdb_key.mv_data);
+    else
+        m_last_key.reset();
+}
+
+int Storage::updateIndex(MDB_txn *const t_transaction, const Key t_key)
+{
+    Key bucket = t_key / kIndexBucket;
+
+    const uint64_t epoch = s_discard_epoch.load(std::memory_order_relaxed);
+    if (bucket == m_indexed_bucket && t_key >= m_indexed_key && epoch == m_indexed_epoch)
+        return MDB_SUCCESS;
+
+    Key     key = t_key;
+    MDB_val mdb_bucket{
+        .mv_size = sizeof(Key),
+        .mv_data = &bucket,
+    };
+    MDB_val mdb_key{
+        .mv_size = sizeof(Key),
+        .mv_data = &key,
+    };
+
+    int result = mdb_put(t_transaction, m_index_dbi, &mdb_bucket, &mdb_key, MDB_NOOVERWRITE);
+
+    // an out of order write can be the new first key of its bucket
+    if (result == MDB_KEYEXIST)
+    {
+        const Key existing = *static_cast<const Key *>(mdb_key.mv_data);
+        if (t_key < existing)
+        {
+            mdb_key.mv_data = &key;
+            result          = mdb_put(t_transaction, m_index_dbi, &mdb_bucket, &mdb_key, 0);
+        }
+        else
+        {
+            key    = existing;
+            result = MDB_SUCCESS;
+        }
+    }
+
+    if (result == MDB_SUCCESS)
+    {
+        m_indexed_bucket = bucket;
+        m_indexed_key    = key;
+        m_indexed_epoch  = epoch;
+    }
+
+    return result;
+}
+
+#if FEATURE_ZSTD
+static thread_local std::vector<char> s_serialize_buffer;
+static thread_local std::vector<char> s_encode_buffer;
+#endif
+
+bool Storage::store(Key t_key, const google::protobuf::MessageLite &t_message, Batch *const t_batch)
+{
+#if FEATURE_ZSTD
+    // the compressed size is needed before lmdb can reserve the value
+    if (m_codec.enabled())
+    {
+        s_serialize_buffer.resize(t_message.ByteSizeLong());
+        if (!t_message.SerializeToArray(s_serialize_buffer.data(), s_serialize_buffer.size()))
+        {
+            logError("Failed to serialize protobuf message for db storage");
+            return false;
+        }
+
+        return storeRaw(t_key, s_serialize_buffer, t_batch);
+    }
+#endif
+
+    const size_t message_size = t_message.ByteSizeLong();
+
+    // serialize directly into the buffer reserved by lmdb
+    return put(
+        t_key, message_size,
+        [&t_message](void *const t_buffer, const size_t t_size)
+        {
+            if (!t_message.SerializeToArray(t_buffer, t_size))
+            {
+                logError("Failed to serialize protobuf message for db storage");
+                return false;
+            }
+            return true;
+        },
+        t_batch);
+}
+
+bool Storage::storeRaw(Key t_key, std::span<const char> t_data, Batch *const t_batch)
+{
+#if FEATURE_ZSTD
+    // stays uncompressed if that doesn't make it smaller
+    if (m_codec.encode(t_data, &s_encode_buffer))
+        t_data = s_encode_buffer;
+#endif
+
+    return put(
+        t_key, t_data.size(),
+        [t_data](void *const t_buffer, const size_t t_size)
+        {
+            std::memcpy(t_buffer, t_data.data(), t_size);
+            return true;
+        },
+        t_batch);
+}
+
+template <typename Fill>
+bool Storage::put(Key t_key, const size_t t_size, Fill &&t_fill, Batch *const t_batch)
+{
+    MDB_val mdb_key{
+        .mv_size = sizeof(Key),
+        .mv_data = &t_key,
+    };
+
+    // retried once if the map was full and could be grown right away
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        MDB_txn *transaction = beginWrite(t_batch);
+        if (transaction == nullptr)
+            return false;
+
+        MDB_val mdb_data{
+            .mv_size = t_size,
+            .mv_data = nullptr,
+        };
+
+        // writes thrown away since can have left the last key we knew of ahead of what is stored
+        if (m_last_key_epoch != s_discard_epoch.load(std::memory_order_relaxed))
+            loadLastKey(transaction);
+
+        bool append = !m_last_key.has_value() || t_key > m_last_key.value();
+
+        int result = mdb_put(transaction, m_dbi, &mdb_key, &mdb_data, append ? MDB_RESERVE | MDB_APPEND : MDB_RESERVE);
+
+        // another writer got a later key in, so the last key we knew of was stale
+        if (append && result == MDB_KEYEXIST)
+        {
+            append = false;
+            result = mdb_put(transaction, m_dbi, &mdb_key, &mdb_data, MDB_RESERVE);
+        }
+
+        if (result == MDB_SUCCESS)
+        {
+            if (!t_fill(mdb_data.mv_data, mdb_data.mv_size))
+            {
+                abortWrite(transaction, t_batch);
+                return false;
+            }
+
+            result = updateIndex(transaction, t_key);
+        }
+
+        if (result != MDB_SUCCESS)
+        {
+            logError("lmdb put for key [{}] with size {} failed with: {}", t_key, t_size, getErrorString(result));
+
+            // a failed put leaves the transaction unusable, which loses the earlier writes of a batch too
+            abortWrite(transaction, t_batch);
+
+            // no transaction of ours is open anymore, so the map can grow unless another one is in the way
+            if (result == MDB_MAP_FULL && attempt == 0 && growMap())
+                continue;
+
+            return false;
+        }
+
+        if (append)
+        {
+            m_last_key = t_key;
+            m_counters->appended.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            m_counters->out_of_order.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        return endWrite(transaction, t_batch);
+    }
+
+    return false;
+}
+
+void Storage::reserveMap()
+{
+    MDB_envinfo info;
+    MDB_stat    stat;
+    if (mdb_env_info(s_env, &info) != MDB_SUCCESS || mdb_env_stat(s_env, &stat) != MDB_SUCCESS)
+        return;
+
+    const size_t used = (info.me_last_pgno + 1) * stat.ms_psize;
+    if (info.me_mapsize - std::min(used, info.me_mapsize) < s_options.map_growth / 2)
+        growMap();
+}
+
+bool Storage::growMap()
+{
+    bool expected = false;
+    if (!s_resizing.compare_exchange_strong(expected, true))
+        return false;
+
+    // checked once, the next transaction boundary tries again rather than stalling the writer here
+    if (s_active_transactions.load() > 0)
+    {
+        s_resizing.store(false);
+        return false;
+    }
+
+    MDB_envinfo info;
+    int         result = mdb_env_info(s_env, &info);
+    if (result == MDB_SUCCESS)
+        result = mdb_env_set_mapsize(s_env, info.me_mapsize + s_options.map_growth);
+
+    s_resizing.store(false);
+
+    if (result != MDB_SUCCESS)
+    {
+        logError("lmdb map resize failed with: {}", getErrorString(result));
+        return false;
+    }
+
+    logInfo("Grew lmdb map to {} MB", (info.me_mapsize + s_options.map_growth) / (1024 * 1024));
+    return true;
+}
+
+MDB_txn *Storage::beginWrite(Batch *const t_batch)
+{
+    if (t_batch != nullptr)
+    {
+        if (!t_batch->active() && !t_batch->begin())
+            return nullptr;
+
+        return t_batch->m_transaction;
+    }
+
+    enterTransaction();
+
+    MDB_txn  *transaction;
+    const int result = mdb_txn_begin(s_env, nullptr, 0, &transaction);
+    if (result != MDB_SUCCESS)
+    {
+        logError("lmdb read/write transaction begin failed with: {}", getErrorString(result));
+
+        leaveTransaction();
+        return nullptr;
+    }
+
+    return transaction;
+}
+
+bool Storage::endWrite(MDB_txn *const t_transaction, Batch *const t_batch)
+{
+    if (t_batch != nullptr)
+    {
+        ++t_batch->m_count;
+        return t_batch->flush();
+    }
+
+    const int result = mdb_txn_commit(t_transaction);
+
+    leaveTransaction();
+
     if (result != MDB_SUCCESS)
     {
         logError("lmdb transaction commit failed with: {}", getErrorString(result));
 
-        mdb_txn_abort(transaction);
+        s_discard_epoch.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    reserveMap();
+    return true;
+}
+
+void Storage::abortWrite(MDB_txn *const t_transaction, Batch *const t_batch)
+{
+    if (t_batch != nullptr)
+    {
+        t_batch->drop();
+    }
+    else
+    {
+        mdb_txn_abort(t_transaction);
+        s_discard_epoch.fetch_add(1, std::memory_order_relaxed);
+
+        leaveTransaction();
+    }
+}
+
+Storage::View::~View()
+{
+    reset();
+}
+
+Storage::View::View(View &&t_other) noexcept
+    : m_transaction(std::exchange(t_other.m_transaction, nullptr)), m_key(std::exchange(t_other.m_key, 0)),
+      m_data(std::exchange(t_other.m_data, {})), m_buffer(std::move(t_other.m_buffer))
+{}
+
+Storage::View &Storage::View::operator=(View &&t_other) noexcept
+{
+    if (this != &t_other)
+    {
+        reset();
+
+        m_transaction = std::exchange(t_other.m_transaction, nullptr);
+        m_key         = std::exchange(t_other.m_key, 0);
+        m_data        = std::exchange(t_other.m_data, {});
+        m_buffer      = std::move(t_other.m_buffer);
+    }
+    return *this;
+}
+
+void Storage::View::reset()
+{
+    endRead(m_transaction);
+
+    m_transaction = nullptr;
+    m_key         = 0;
+    m_data        = {};
+}
+
+bool Storage::View::parse(google::protobuf::MessageLite *const t_message) const
+{
+    if (!valid())
+        return false;
+
+    if (!t_message->ParseFromArray(m_data.data(), m_data.size()))
+    {
+        logError("Failed to parse protobuf message with size {} from db", m_data.size());
+        return false;
+    }
+
+    return true;
+}
+
+Storage::Range::~Range()
+{
+    reset();
+}
+
+Storage::Range::Range(Range &&t_other) noexcept
+    : m_storage(t_other.m_storage), m_transaction(std::exchange(t_other.m_transaction, nullptr)),
+      m_cursor(std::exchange(t_other.m_cursor, nullptr)), m_to(t_other.m_to),
+      m_valid(std::exchange(t_other.m_valid, false)), m_record(std::exchange(t_other.m_record, {})),
+      m_buffer(std::move(t_other.m_buffer))
+{}
+
+Storage::Range &Storage::Range::operator=(Range &&t_other) noexcept
+{
+    if (this != &t_other)
+    {
+        reset();
+
+        m_storage     = t_other.m_storage;
+        m_transaction = std::exchange(t_other.m_transaction, nullptr);
+        m_cursor      = std::exchange(t_other.m_cursor, nullptr);
+        m_to          = t_other.m_to;
+        m_valid       = std::exchange(t_other.m_valid, false);
+        m_record      = std::exchange(t_other.m_record, {});
+        m_buffer      = std::move(t_other.m_buffer);
+    }
+    return *this;
+}
+
+void Storage::Range::reset()
+{
+    if (m_cursor != nullptr)
+        mdb_cursor_close(m_cursor);
+
+    endRead(m_transaction);
+
+    m_transaction = nullptr;
+    m_cursor      = nullptr;
+    m_valid       = false;
+    m_record      = {};
+}
+
+bool Storage::Range::advance()
+{
+    if (!m_valid)
+        return false;
+
+    MDB_val mdb_key, mdb_data;
+
+    const int result = mdb_cursor_get(m_cursor, &mdb_key, &mdb_data, MDB_NEXT);
+    return update(result, mdb_key, mdb_data);
+}
+
+bool Storage::Range::update(const int t_result, const MDB_val &t_key, const MDB_val &t_data)
+{
+    m_valid = false;
+
+    if (t_result == MDB_NOTFOUND)
+        return false;
+
+    if (t_result != MDB_SUCCESS)
+    {
+        logError("lmdb cursor get failed with: {}", getErrorString(t_result));
         return false;
     }
 
+    const Key key = *static_cast<const Key *>(t_key.mv_data);
+    if (key >= m_to)
+        return false;
+
+    m_record = {
+        .key  = key,
+        .data = {static_cast<const char *>(t_data.mv_data), t_data.mv_size},
+    };
+
+    if (!m_storage->decode(m_transaction, &m_record.data, &m_buffer))
+        return false;
+
+    m_valid = true;
     return true;
 }
+
+Storage::Batch::~Batch()
+{
+    commit();
+}
+
+bool Storage::Batch::begin()
+{
+    if (active())
+        return true;
+
+    enterTransaction();
+
+    const int result = mdb_txn_begin(s_env, nullptr, 0, &m_transaction);
+    if (result != MDB_SUCCESS)
+    {
+        logError("lmdb batch transaction begin failed with: {}", getErrorString(result));
+
+        m_transaction = nullptr;
+        leaveTransaction();
+        return false;
+    }
+
+    m_begin_time = TimePoint::now();
+    m_count      = 0;
+
+    return true;
+}
+
+bool Storage::Batch::commit()
+{
+    if (!active())
+        return true;
+
+    const int result = mdb_txn_commit(m_transaction);
+    if (result != MDB_SUCCESS)
+    {
+        logError("lmdb batch commit of {} writes failed with: {}", m_count, getErrorString(result));
+
+        finish(true);
+        return false;
+    }
+
+    finish(false);
+
+    // the boundary between two batches is where the map can grow without holding up a write
+    reserveMap();
+    return true;
+}
+
+void Storage::Batch::abort()
+{
+    if (!active())
+        return;
+
+    if (m_count > 0)
+        logWarning("Discarding {} pending writes of the lmdb batch", m_count);
+
+    mdb_txn_abort(m_transaction);
+    finish(false);
+
+    s_discard_epoch.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Storage::Batch::drop()
+{
+    if (!active())
+        return;
+
+    if (m_count > 0)
+        logError("Lost {} writes of the lmdb batch", m_count);
+
+    mdb_txn_abort(m_transaction);
+    finish(true);
+}
+
+void Storage::Batch::finish(const bool t_lost)
+{
+    m_transaction = nullptr;
+    leaveTransaction();
+
+    if (t_lost)
+    {
+        s_discard_epoch.fetch_add(1, std::memory_order_relaxed);
+        m_discarded += m_count;
+    }
+
+    m_count = 0;
+}
+
+bool Storage::Batch::flush()
+{
+    if (!active())
+        return true;
+
+    if (m_count < m_max_count && TimePoint::now() - m_begin_time < m_window)
+        return true;
+
+    return commit();
+}
 } // namespace Immortals::Common
@@ -1,13 +1,243 @@
-
 #pragma once
 
+#include "../time/time_point.h"
+
+#if FEATURE_ZSTD
+#include "zstd_codec.h"
+#endif
+
 namespace Immortals::Common
 {
+struct StorageOptions
+{
+    // Initial size of the memory map, it grows by map_growth between transactions once it gets close to full
+    size_t map_size   = 1llu * 1024llu * 1024llu * 1024llu; // 1 GB
+    size_t map_growth = 1llu * 1024llu * 1024llu * 1024llu; // 1 GB
+
+    // Trade durability of the last commits on a system crash for throughput
+    bool no_sync      = false; // MDB_NOSYNC
+    bool no_meta_sync = false; // MDB_NOMETASYNC
+
+    bool write_map     = false; // MDB_WRITEMAP
+    bool no_read_ahead = false; // MDB_NORDAHEAD
+};
+
 class Storage
 {
 public:
     using Key = size_t;
 
+    // Keys are microsecond timestamps, the time index keeps the first key of every bucket
+    static constexpr Key kIndexBucket = 1'000'000;
+
+    using Options = StorageOptions;
+
+    // Groups the writes of any number of storages into a single lmdb write transaction,
+    // which is committed once the durability window has passed or enough writes are pending.
+    // lmdb binds write transactions to the thread that began them, so a batch
+    // should only be used from a single thread.
+    class Batch
+    {
+    public:
+        explicit Batch(Duration t_window = Duration::fromMilliseconds(100), size_t t_max_count = 1024)
+            : m_window(t_window), m_max_count(t_max_count)
+        {}
+
+        ~Batch();
+
+        Batch(const Batch &)            = delete;
+        Batch &operator=(const Batch &) = delete;
+
+        bool begin();
+        bool commit();
+        void abort();
+
+        // Commits the pending writes if the durability window or the size limit is reached
+        bool flush();
+
+        [[nodiscard]] bool active() const
+        {
+            return m_transaction != nullptr;
+        }
+
+        [[nodiscard]] size_t count() const
+        {
+            return m_count;
+        }
+
+        // Writes that were accepted into the batch but lost since the last call, because its transaction
+        // failed. Doesn't include the ones thrown away by abort().
+        size_t takeDiscarded()
+        {
+            return std::exchange(m_discarded, 0);
+        }
+
+    private:
+        friend class Storage;
+
+        // Aborts the transaction after a failed write, counting its writes as discarded
+        void drop();
+
+        // Forgets the transaction once it was committed or aborted, t_lost counts its writes as discarded
+        void finish(bool t_lost);
+
+        MDB_txn *m_transaction = nullptr;
+
+        size_t m_discarded = 0;
+
+        Duration m_window;
+        size_t   m_max_count;
+
+        TimePoint m_begin_time;
+        size_t    m_count = 0;
+    };
+
+    // Points directly into the memory map of the environment and keeps the read transaction
+    // that makes it valid, so the data must not be used after the view is reset or destroyed.
+    class View
+    {
+    public:
+        View() = default;
+        ~View();
+
+        View(const View &)            = delete;
+        View &operator=(const View &) = delete;
+
+        View(View &&t_other) noexcept;
+        View &operator=(View &&t_other) noexcept;
+
+        void reset();
+
+        bool parse(google::protobuf::MessageLite *t_message) const;
+
+        [[nodiscard]] bool valid() const
+        {
+            return m_transaction != nullptr;
+        }
+
+        [[nodiscard]] Key key() const
+        {
+            return m_key;
+        }
+
+        [[nodiscard]] std::span<const char> data() const
+        {
+            return m_data;
+        }
+
+    private:
+        friend class Storage;
+
+        MDB_txn *m_transaction = nullptr;
+
+        Key                   m_key = 0;
+        std::span<const char> m_data;
+
+        // holds the value instead of the map if it had to be decompressed
+        std::vector<char> m_buffer;
+    };
+
+    struct Record
+    {
+        Key                   key = 0;
+        std::span<const char> data;
+    };
+
+    // Sequential pass over the keys in [from, to) using a single read transaction and cursor.
+    // Like a view, the records point into the memory map and are only valid while the range is alive.
+    class Range
+    {
+    public:
+        class Iterator
+        {
+        public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type        = Record;
+            using difference_type   = std::ptrdiff_t;
+            using pointer           = const Record *;
+            using reference         = const Record &;
+
+            reference operator*() const
+            {
+                return m_range->m_record;
+            }
+
+            pointer operator->() const
+            {
+                return &m_range->m_record;
+            }
+
+            Iterator &operator++()
+            {
+                m_range->advance();
+                return *this;
+            }
+
+            void operator++(int)
+            {
+                m_range->advance();
+            }
+
+            bool operator==(std::default_sentinel_t) const
+            {
+                return !m_range->m_valid;
+            }
+
+        private:
+            friend class Range;
+
+            explicit Iterator(Range *const t_range) : m_range(t_range)
+            {}
+
+            Range *m_range;
+        };
+
+        Range() = default;
+        ~Range();
+
+        Range(const Range &)            = delete;
+        Range &operator=(const Range &) = delete;
+
+        Range(Range &&t_other) noexcept;
+        Range &operator=(Range &&t_other) noexcept;
+
+        void reset();
+
+        // Single pass: the iterator and the range share the cursor position
+        Iterator begin()
+        {
+            return Iterator{this};
+        }
+
+        std::default_sentinel_t end() const
+        {
+            return {};
+        }
+
+    private:
+        friend class Storage;
+
+        bool advance();
+        bool update(int t_result, const MDB_val &t_key, const MDB_val &t_data);
+
+        const Storage *m_storage = nullptr;
+
+        MDB_txn    *m_transaction = nullptr;
+        MDB_cursor *m_cursor      = nullptr;
+
+        Key    m_to    = 0;
+        bool   m_valid = false;
+        Record m_record;
+
+        std::vector<char> m_buffer;
+    };
+
+    struct WriteStats
+    {
+        size_t appended     = 0; // went to the end of the tree with MDB_APPEND
+        size_t out_of_order = 0; // not after the last key, so they needed a regular put
+    };
+
     Storage() = default;
 
     bool open(std::string_view t_name);
@@ -15,26 +245,145 @@ public:
 
     bool get(Key t_key, google::protobuf::MessageLite *t_message) const;
 
+    // Same lookup as get, but hands out the stored bytes without copying or parsing them
+    bool getRaw(Key t_key, View *t_view) const;
+
     bool closest(Key t_key, Key *t_closest) const;
     bool next(Key t_key, Key *t_next) const;
 
+    // Positions t_range on the first key at or after t_from, stopping before t_to
+    bool range(Key t_from, Key t_to, Range *t_range) const;
+
     unsigned long getBoundary(Key *t_first, Key *t_last) const;
-    bool          store(Key t_key, const google::protobuf::MessageLite &t_message);
 
-    bool storeRaw(Key t_key, std::span<char> t_data);
+    // First keys of the time index buckets in [t_from, t_to), without touching the records
+    bool indexKeys(Key t_from, Key t_to, std::vector<Key> *t_keys) const;
+
+    // First key at or after every t_step from t_from until t_to, skipping repeated keys.
+    // Targets at or just before the first key of a bucket are answered by the time index alone.
+    bool sample(Key t_from, Key t_to, Key t_step, std::vector<Key> *t_keys) const;
+
+    // Aligns all storages to t_key in a single read transaction, t_keys is left empty where nothing is found.
+    // Like sample, a storage's records are only searched when its time index can't answer alone.
+    static bool seekAll(std::span<const Storage *const> t_storages, Key t_key, std::span<std::optional<Key>> t_keys);
+
+    // Recreates the time index from the records, for recordings made before it existed
+    bool rebuildIndex();
+
+    // Writes are committed immediately, unless a batch is given
+    bool store(Key t_key, const google::protobuf::MessageLite &t_message, Batch *t_batch = nullptr);
+    bool storeRaw(Key t_key, std::span<const char> t_data, Batch *t_batch = nullptr);
+
+#if FEATURE_ZSTD
+    // Compresses the values stored from now on. The dictionary is saved in the environment,
+    // so the records can be read back without having it at hand. Copies of the storage aren't affected.
+    bool enableCompression(int t_level, std::span<const char> t_dictionary = {});
+    void disableCompression();
+#endif
+
+    [[nodiscard]] WriteStats writeStats() const
+    {
+        return {
+            .appended     = m_counters->appended.load(std::memory_order_relaxed),
+            .out_of_order = m_counters->out_of_order.load(std::memory_order_relaxed),
+        };
+    }
+
+    // Effective settings of the environment, including the current map size
+    static Options options();
 
 protected:
-    static bool init(const std::filesystem::path &t_path);
+    static bool init(const std::filesystem::path &t_path, const Options &t_options = {});
     static void shutdown();
 
     friend struct Services;
 
 private:
-    static constexpr size_t kMaxDbCount = 10;
-    static constexpr size_t kMapSize    = 100llu * 1024llu * 1024llu * 1024llu; // 1 GB
+    // Positions a temporary cursor with t_op, and moves it once more with t_then if given
+    int seek(MDB_txn *t_transaction, MDB_val *t_key, MDB_val *t_data, MDB_cursor_op t_op,
+             std::optional<MDB_cursor_op> t_then = {}) const;
+
+    // Points t_data to the decompressed value in t_buffer if it was stored compressed
+    bool decode(MDB_txn *t_transaction, std::span<const char> *t_data, std::vector<char> *t_buffer) const;
+
+    static MDB_txn *beginRead();
+    static void     endRead(MDB_txn *t_transaction);
+
+    // Every transaction of this process is counted, so the map is only resized while none is open
+    static void enterTransaction();
+    static void leaveTransaction();
+
+    // Reads the last stored key into m_last_key
+    void loadLastKey(MDB_txn *t_transaction);
+
+    // First key at or after t_key. The time index answers it alone when t_key's bucket is empty or t_key
+    // doesn't come after the bucket's first key, the records are only searched otherwise or without an index.
+    int seekIndexed(MDB_cursor *t_index_cursor, MDB_cursor *t_cursor, Key t_key, Key *t_found) const;
+
+    // Whether the time index starts where the records do, it doesn't for recordings made before it existed
+    bool checkIndex(MDB_txn *t_transaction) const;
+
+    int updateIndex(MDB_txn *t_transaction, Key t_key);
+
+    // Reserves t_size bytes for t_key and lets t_fill write the value in place
+    template <typename Fill>
+    bool put(Key t_key, size_t t_size, Fill &&t_fill, Batch *t_batch);
+
+    // Called between transactions to grow the map before it runs out. Resizing needs every transaction of
+    // the process to be closed, so it gives up at once instead of waiting when one is open.
+    static void reserveMap();
+    static bool growMap();
+
+    static MDB_txn *beginWrite(Batch *t_batch);
+    static bool     endWrite(MDB_txn *t_transaction, Batch *t_batch);
+    static void     abortWrite(MDB_txn *t_transaction, Batch *t_batch);
+
+    static constexpr size_t kMaxDbCount     = 32;
+    static constexpr size_t kMaxCachedReads = 2;
 
     inline static MDB_env *s_env = nullptr;
 
-    MDB_dbi m_dbi = 0;
+    inline static Options s_options;
+
+    // lets readers hold pointers into the map without a lock that has to be released on the same thread
+    inline static std::atomic<size_t> s_active_transactions = 0;
+    inline static std::atomic<bool>   s_resizing            = false;
+
+    // bumped whenever pending writes are thrown away, as the index entries cached below may be gone too
+    inline static std::atomic<uint64_t> s_discard_epoch = 0;
+
+    MDB_dbi m_dbi       = 0;
+    MDB_dbi m_index_dbi = 0;
+
+    // seeks only go through the index once it covers every record
+    bool m_index_complete = false;
+
+    // keys usually grow with time, so records are appended unless they come before this one.
+    // It's read again from the db after writes were thrown away, as it may be ahead of what is stored.
+    std::optional<Key> m_last_key;
+    uint64_t           m_last_key_epoch = 0;
+
+    struct Counters
+    {
+        std::atomic<size_t> appended     = 0;
+        std::atomic<size_t> out_of_order = 0;
+    };
+
+    // shared so storages stay copyable
+    std::shared_ptr<Counters> m_counters = std::make_shared<Counters>();
+
+    // the last index entry this storage wrote, to skip the index lookup for the rest of the bucket
+    Key      m_indexed_bucket = std::numeric_limits<Key>::max();
+    Key      m_indexed_key    = 0;
+    uint64_t m_indexed_epoch  = 0;
+
+#if FEATURE_ZSTD
+    static constexpr std::string_view kDictionariesDb = "zstd_dictionaries";
+
+    inline static MDB_dbi s_dictionaries_dbi = 0;
+
+    // a copy of the storage gets its own compression settings
+    ZstdCodec m_codec;
+#endif
 };
 } // namespace Immortals::Common
@@ -0,0 +1,209 @@
+#include "zstd_codec.h"
+
+namespace Immortals::Common
+{
+// contexts keep their internal buffers between frames, so one is kept per thread
+struct ZstdContexts
+{
+    ZSTD_CCtx *compress   = ZSTD_createCCtx();
+    ZSTD_DCtx *decompress = ZSTD_createDCtx();
+
+    ~ZstdContexts()
+    {
+        ZSTD_freeCCtx(compress);
+        ZSTD_freeDCtx(decompress);
+    }
+};
+
+static thread_local ZstdContexts s_contexts;
+
+ZstdCodec::Compressor::~Compressor()
+{
+    ZSTD_freeCDict(dictionary);
+}
+
+ZstdCodec::Decompressor::~Decompressor()
+{
+    for (const auto &entry : dictionaries)
+        ZSTD_freeDDict(entry.second);
+}
+
+ZstdCodec::ZstdCodec(const ZstdCodec &t_other)
+    : m_compressor(t_other.compressor()), m_decompressor(t_other.m_decompressor)
+{}
+
+ZstdCodec &ZstdCodec::operator=(const ZstdCodec &t_other)
+{
+    if (this != &t_other)
+    {
+        std::shared_ptr<const Compressor> compressor = t_other.compressor();
+
+        const std::lock_guard lock{m_compress_mutex};
+        m_compressor   = std::move(compressor);
+        m_decompressor = t_other.m_decompressor;
+    }
+    return *this;
+}
+
+bool ZstdCodec::enable(const int t_level, const std::span<const char> t_dictionary)
+{
+    disable();
+
+    auto compressor   = std::make_shared<Compressor>();
+    compressor->level = t_level;
+
+    if (!t_dictionary.empty())
+    {
+        compressor->dictionary = ZSTD_createCDict(t_dictionary.data(), t_dictionary.size(), t_level);
+        if (compressor->dictionary == nullptr)
+        {
+            logError("Failed to create zstd dictionary with size {}", t_dictionary.size());
+            return false;
+        }
+
+        compressor->dictionary_id = ZSTD_getDictID_fromDict(t_dictionary.data(), t_dictionary.size());
+    }
+
+    const std::lock_guard lock{m_compress_mutex};
+    m_compressor = std::move(compressor);
+
+    return true;
+}
+
+void ZstdCodec::disable()
+{
+    // freed by the last encode still using it
+    const std::lock_guard lock{m_compress_mutex};
+    m_compressor.reset();
+}
+
+bool ZstdCodec::encode(const std::span<const char> t_data, std::vector<char> *const t_buffer) const
+{
+    const std::shared_ptr<const Compressor> compressor = this->compressor();
+    if (compressor == nullptr || t_data.size() > kMaxDecodedSize)
+        return false;
+
+    t_buffer->resize(1 + ZSTD_compressBound(t_data.size()));
+    t_buffer->front() = kHeader;
+
+    char *const  destination = t_buffer->data() + 1;
+    const size_t capacity    = t_buffer->size() - 1;
+
+    const size_t result =
+        compressor->dictionary != nullptr
+            ? ZSTD_compress_usingCDict(s_contexts.compress, destination, capacity, t_data.data(), t_data.size(),
+                                       compressor->dictionary)
+            : ZSTD_compressCCtx(s_contexts.compress, destination, capacity, t_data.data(), t_data.size(),
+                                compressor->level);
+
+    if (ZSTD_isError(result))
+    {
+        logError("zstd compression of {} bytes failed with: {}", t_data.size(), ZSTD_getErrorName(result));
+        return false;
+    }
+
+    t_buffer->resize(1 + result);
+
+    return t_buffer->size() < t_data.size();
+}
+
+bool ZstdCodec::decode(const std::span<const char> t_data, std::vector<char> *const t_buffer,
+                       const DictionaryLoader &t_loader) const
+{
+    if (!isEncoded(t_data))
+        return false;
+
+    const std::span<const char> frame = t_data.subspan(1);
+
+    const unsigned long long content_size = ZSTD_getFrameContentSize(frame.data(), frame.size());
+    if (content_size == ZSTD_CONTENTSIZE_UNKNOWN || content_size == ZSTD_CONTENTSIZE_ERROR)
+    {
+        logError("Invalid zstd frame with size {}", frame.size());
+        return false;
+    }
+
+    if (content_size > kMaxDecodedSize)
+    {
+        logError("zstd frame with size {} claims {} bytes of content, more than the limit of {}", frame.size(),
+                 content_size, kMaxDecodedSize);
+        return false;
+    }
+
+    t_buffer->resize(content_size);
+
+    const ZSTD_DDict *dictionary    = nullptr;
+    const unsigned    dictionary_id = ZSTD_getDictID_fromFrame(frame.data(), frame.size());
+
+    if (dictionary_id != 0)
+    {
+        const std::lock_guard lock{m_decompressor->mutex};
+
+        auto it = m_decompressor->dictionaries.find(dictionary_id);
+        if (it == m_decompressor->dictionaries.end())
+        {
+            std::vector<char> dictionary_data;
+            if (!t_loader(dictionary_id, &dictionary_data))
+            {
+                logError("zstd dictionary {} is not available", dictionary_id);
+                return false;
+            }
+
+            ZSTD_DDict *const created = ZSTD_createDDict(dictionary_data.data(), dictionary_data.size());
+            if (created == nullptr)
+            {
+                logError("Failed to create zstd dictionary {}", dictionary_id);
+                return false;
+            }
+
+            it = m_decompressor->dictionaries.emplace(dictionary_id, created).first;
+        }
+
+        dictionary = it->second;
+    }
+
+    const size_t result = dictionary != nullptr
+                              ? ZSTD_decompress_usingDDict(s_contexts.decompress, t_buffer->data(), t_buffer->size(),
+                                                           frame.data(), frame.size(), dictionary)
+                              : ZSTD_decompressDCtx(s_contexts.decompress, t_buffer->data(), t_buffer->size(),
+                                                    frame.data(), frame.size());
+
+    if (ZSTD_isError(result))
+    {
+        logError("zstd decompression of {} bytes failed with: {}", frame.size(), ZSTD_getErrorName(result));
+        return false;
+    }
+
+    return true;
+}
+
+bool ZstdCodec::train(const std::span<const std::span<const char>> t_samples, const size_t t_size,
+                      std::vector<char> *const t_dictionary)
+{
+    // zdict wants the samples back to back
+    std::vector<char>   samples;
+    std::vector<size_t> sample_sizes;
+    sample_sizes.reserve(t_samples.size());
+
+    for (const std::span<const char> sample : t_samples)
+    {
+        samples.insert(samples.end(), sample.begin(), sample.end());
+        sample_sizes.push_back(sample.size());
+    }
+
+    t_dictionary->resize(t_size);
+
+    const size_t result = ZDICT_trainFromBuffer(t_dictionary->data(), t_dictionary->size(), samples.data(),
+                                                sample_sizes.data(), static_cast<unsigned>(sample_sizes.size()));
+    if (ZDICT_isError(result))
+    {
+        logError("zstd dictionary training on {} samples failed with: {}", t_samples.size(),
+                 ZDICT_getErrorName(result));
+
+        t_dictionary->clear();
+        return false;
+    }
+
+    t_dictionary->resize(result);
+    return true;
+}
+} // namespace Immortals::Common
@@ -0,0 +1,92 @@
+#pragma once
+
+namespace Immortals::Common
+{
+// Compresses stored values with zstd, optionally using a dictionary trained on samples of the stream.
+// Encoded values start with a header byte that no serialized protobuf message starts with
+// (field number 0 is invalid), so they can be mixed with the plain records of older recordings.
+class ZstdCodec
+{
+public:
+    using DictionaryLoader = std::function<bool(unsigned t_id, std::vector<char> *t_dictionary)>;
+
+    static constexpr char kHeader = 0x01;
+
+    // Larger values are stored as they are, so a corrupt frame can't claim an arbitrary size
+    static constexpr size_t kMaxDecodedSize = 256llu * 1024llu * 1024llu; // 256 MB
+
+    ZstdCodec() = default;
+
+    // A copy starts with the same settings but is enabled and disabled on its own,
+    // while the dictionaries loaded for decoding stay shared
+    ZstdCodec(const ZstdCodec &t_other);
+    ZstdCodec &operator=(const ZstdCodec &t_other);
+
+    // An empty dictionary compresses without one. Safe to call while another thread encodes,
+    // which finishes its frame with the settings it started with.
+    bool enable(int t_level, std::span<const char> t_dictionary = {});
+    void disable();
+
+    [[nodiscard]] bool enabled() const
+    {
+        return compressor() != nullptr;
+    }
+
+    // 0 if no dictionary is used
+    [[nodiscard]] unsigned dictionaryId() const
+    {
+        const std::shared_ptr<const Compressor> compressor = this->compressor();
+        return compressor != nullptr ? compressor->dictionary_id : 0;
+    }
+
+    static bool isEncoded(const std::span<const char> t_data)
+    {
+        return !t_data.empty() && t_data.front() == kHeader;
+    }
+
+    // Returns false if the data should rather be stored as is, either on failure or if it doesn't get smaller
+    bool encode(std::span<const char> t_data, std::vector<char> *t_buffer) const;
+
+    // Dictionaries of frames are looked up by their id and loaded through t_loader the first time
+    bool decode(std::span<const char> t_data, std::vector<char> *t_buffer, const DictionaryLoader &t_loader) const;
+
+    static bool train(std::span<const std::span<const char>> t_samples, size_t t_size,
+                      std::vector<char> *t_dictionary);
+
+private:
+    // The settings of enable(), never changed once created
+    struct Compressor
+    {
+        int         level         = 0;
+        ZSTD_CDict *dictionary    = nullptr;
+        unsigned    dictionary_id = 0;
+
+        Compressor() = default;
+        ~Compressor();
+
+        Compressor(const Compressor &)            = delete;
+        Compressor &operator=(const Compressor &) = delete;
+    };
+
+    struct Decompressor
+    {
+        std::mutex                                 mutex;
+        std::unordered_map<unsigned, ZSTD_DDict *> dictionaries;
+
+        ~Decompressor();
+    };
+
+    std::shared_ptr<const Compressor> compressor() const
+    {
+        const std::lock_guard lock{m_compress_mutex};
+        return m_compressor;
+    }
+
+    // replaced as a whole, an encode holds on to the one it started with until it's done
+    mutable std::mutex                m_compress_mutex;
+    std::shared_ptr<const Compressor> m_compressor;
+
+    // the dictionary of an id never changes, so copies share them
+    std::shared_ptr<Decompressor> m_decompressor = std::make_shared<Decompressor>();
+};
+} // namespace Immortals::Common